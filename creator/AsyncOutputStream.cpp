@@ -0,0 +1,126 @@
+#include "AsyncOutputStream.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+AsyncOutputStreamBuffer::AsyncOutputStreamBuffer(std::shared_ptr<std::ostream> target, std::size_t bufferSize, std::size_t queueSize) :
+m_target(target),
+m_bufferSize(std::max<std::size_t>(bufferSize, 1)),
+m_queueSize(std::max<std::size_t>(queueSize, 1))
+{
+	//one buffer is filled while the others are queued or written
+	m_storage.reset(new char[(m_queueSize+1)*m_bufferSize]);
+	for(std::size_t i(1); i <= m_queueSize; ++i) {
+		m_free.push_back(m_storage.get() + i*m_bufferSize);
+	}
+	setp(m_storage.get(), m_storage.get() + m_bufferSize);
+	m_thread = std::thread([this]() { run(); });
+}
+
+AsyncOutputStreamBuffer::~AsyncOutputStreamBuffer() {
+	sync();
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_stop = true;
+	}
+	m_filledCv.notify_all();
+	m_thread.join();
+}
+
+bool AsyncOutputStreamBuffer::submit() {
+	std::unique_lock<std::mutex> lck(m_mtx);
+	if (pptr() == pbase()) {
+		return !m_failed;
+	}
+	m_filled.push_back(Buffer{pbase(), std::size_t(pptr() - pbase())});
+	m_queueDepth.store(m_filled.size() + m_writing, std::memory_order_relaxed);
+	m_filledCv.notify_one();
+	if (m_free.empty()) {
+		auto waitBegin = std::chrono::steady_clock::now();
+		m_freeCv.wait(lck, [this]() { return !m_free.empty(); });
+		auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - waitBegin);
+		m_waitTime.fetch_add(waited.count(), std::memory_order_relaxed);
+	}
+	char * buffer = m_free.back();
+	m_free.pop_back();
+	setp(buffer, buffer + m_bufferSize);
+	return !m_failed;
+}
+
+void AsyncOutputStreamBuffer::run() {
+	std::unique_lock<std::mutex> lck(m_mtx);
+	while (true) {
+		m_filledCv.wait(lck, [this]() { return m_stop || !m_filled.empty(); });
+		if (m_filled.empty()) {
+			return;
+		}
+		Buffer buffer = m_filled.front();
+		m_filled.pop_front();
+		m_writing = true;
+		lck.unlock();
+		m_target->write(buffer.data, buffer.size);
+		bool ok = bool(*m_target);
+		lck.lock();
+		m_writing = false;
+		m_failed = m_failed || !ok;
+		m_free.push_back(buffer.data);
+		m_queueDepth.store(m_filled.size(), std::memory_order_relaxed);
+		m_freeCv.notify_all();
+	}
+}
+
+AsyncOutputStreamBuffer::int_type AsyncOutputStreamBuffer::overflow(int_type ch) {
+	if (!submit()) {
+		return traits_type::eof();
+	}
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize AsyncOutputStreamBuffer::xsputn(const char * s, std::streamsize n) {
+	std::streamsize written = 0;
+	while (written < n) {
+		std::streamsize available = epptr() - pptr();
+		if (!available) {
+			if (!submit()) {
+				break;
+			}
+			continue;
+		}
+		std::streamsize len = std::min(available, n - written);
+		::memcpy(pptr(), s + written, len);
+		pbump(int(len));
+		written += len;
+	}
+	return written;
+}
+
+int AsyncOutputStreamBuffer::sync() {
+	bool ok = submit();
+	std::unique_lock<std::mutex> lck(m_mtx);
+	m_freeCv.wait(lck, [this]() { return m_filled.empty() && !m_writing; });
+	//the I/O thread is idle, hence the target can be used by this thread
+	m_target->flush();
+	m_failed = m_failed || !ok || !(*m_target);
+	return m_failed ? -1 : 0;
+}
+
+AsyncOutputStream::AsyncOutputStream(std::shared_ptr<std::ostream> target, std::size_t bufferSize, std::size_t queueSize) :
+std::ostream(nullptr),
+m_buffer(target, bufferSize, queueSize)
+{
+	rdbuf(&m_buffer);
+}
+
+AsyncOutputStream::~AsyncOutputStream() {
+	flush();
+}
+
+}}}//end namespace
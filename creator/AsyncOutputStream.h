@@ -0,0 +1,82 @@
+#ifndef OSM_GRAPH_TOOLS_ASYNC_OUTPUT_STREAM_H
+#define OSM_GRAPH_TOOLS_ASYNC_OUTPUT_STREAM_H
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * A stream buffer that writes to a target stream in a dedicated I/O thread.
+ * Data is collected in buffers of bufferSize bytes. Filled buffers are put into a queue of at most queueSize buffers
+ * which the I/O thread drains, hence formatting the output overlaps with the write calls to the target.
+ * If the queue is full the writing thread waits for the I/O thread.
+ *
+ * The target is only accessed by the I/O thread until sync() returns.
+ * Errors of the target are reported by the next call of sync() or when a buffer is submitted.
+ */
+class AsyncOutputStreamBuffer: public std::streambuf {
+public:
+	static constexpr std::size_t DefaultBufferSize = std::size_t(4) << 20;
+	static constexpr std::size_t DefaultQueueSize = 8;
+public:
+	AsyncOutputStreamBuffer(std::shared_ptr<std::ostream> target, std::size_t bufferSize = DefaultBufferSize, std::size_t queueSize = DefaultQueueSize);
+	~AsyncOutputStreamBuffer() override;
+	///number of filled buffers waiting for the I/O thread.
+	///A full queue means that the output is I/O-bound, an empty one that it is bound by the producer
+	inline std::size_t queueDepth() const { return m_queueDepth.load(std::memory_order_relaxed); }
+	inline std::size_t queueSize() const { return m_queueSize; }
+	///seconds the writing thread waited for a free buffer
+	inline double waitTime() const { return m_waitTime.load(std::memory_order_relaxed)/1e9; }
+protected:
+	int_type overflow(int_type ch) override;
+	std::streamsize xsputn(const char * s, std::streamsize n) override;
+	int sync() override;
+private:
+	struct Buffer {
+		char * data;
+		std::size_t size;
+	};
+private:
+	///passes the current buffer to the I/O thread and gets a free one
+	bool submit();
+	void run();
+private:
+	std::shared_ptr<std::ostream> m_target;
+	std::size_t m_bufferSize;
+	std::size_t m_queueSize;
+	std::unique_ptr<char[]> m_storage;
+	std::mutex m_mtx;
+	std::condition_variable m_filledCv;
+	std::condition_variable m_freeCv;
+	std::deque<Buffer> m_filled;
+	std::vector<char*> m_free;
+	bool m_writing{false};
+	bool m_stop{false};
+	bool m_failed{false};
+	std::atomic<std::size_t> m_queueDepth{0};
+	std::atomic<uint64_t> m_waitTime{0}; //in ns
+	std::thread m_thread;
+};
+
+///An output stream using an AsyncOutputStreamBuffer
+class AsyncOutputStream: public std::ostream {
+public:
+	AsyncOutputStream(std::shared_ptr<std::ostream> target, std::size_t bufferSize = AsyncOutputStreamBuffer::DefaultBufferSize, std::size_t queueSize = AsyncOutputStreamBuffer::DefaultQueueSize);
+	~AsyncOutputStream() override;
+	inline const AsyncOutputStreamBuffer & buffer() const { return m_buffer; }
+private:
+	AsyncOutputStreamBuffer m_buffer;
+};
+
+}}}//end namespace
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef OSM_GRAPH_TOOLS_BLOCK_PARSER_H
+#define OSM_GRAPH_TOOLS_BLOCK_PARSER_H
+#include <osmpbf/pbistream.h>
+#include <osmpbf/blobfile.h>
+#include <osmpbf/primitiveblockinputadaptor.h>
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * Stores the file offset of every block of the input and the kind of primitives it contains.
+ * The index is filled during the first pass over the input.
+ * Later passes only read the ranges of blocks that contain the primitives they need.
+ */
+class BlockIndex {
+public:
+	enum Kind : uint8_t {BK_NONE=0x0, BK_NODES=0x1, BK_WAYS=0x2, BK_RELATIONS=0x4};
+public:
+	BlockIndex() {}
+	inline bool valid() const { return m_valid; }
+	inline void add(osmpbf::OffsetType blockBegin, osmpbf::OffsetType blockEnd, osmpbf::PrimitiveBlockInputAdaptor & pbi) {
+		uint8_t kinds = BK_NONE;
+		if (!pbi.isNull()) {
+			kinds |= (pbi.nodesSize() ? BK_NODES : BK_NONE);
+			kinds |= (pbi.waysSize() ? BK_WAYS : BK_NONE);
+			kinds |= (pbi.relationsSize() ? BK_RELATIONS : BK_NONE);
+		}
+		add(blockBegin, blockEnd, kinds);
+	}
+	inline void add(osmpbf::OffsetType blockBegin, osmpbf::OffsetType blockEnd, uint8_t kinds) {
+		assert(!m_valid);
+		m_blocks.push_back(Block{blockBegin, blockEnd, kinds});
+	}
+	///call this after all blocks were added
+	inline void finish() { m_valid = true; }
+	inline void clear() {
+		m_blocks.clear();
+		m_valid = false;
+	}
+	///Calls f(begin, end) for every maximal range of consecutive blocks that contain kind.
+	///If the index is not valid then f is called once for the whole input.
+	template<typename TFunc>
+	void forEachRange(Kind kind, const osmpbf::PbiStream & inFile, TFunc f) const {
+		if (!valid()) {
+			f(osmpbf::OffsetType(0), inFile.dataSize());
+			return;
+		}
+		for(std::size_t i(0), s(m_blocks.size()); i < s;) {
+			if (!(m_blocks[i].kinds & kind)) {
+				++i;
+				continue;
+			}
+			std::size_t j = i+1;
+			for(; j < s && (m_blocks[j].kinds & kind); ++j) {}
+			f(m_blocks[i].begin, m_blocks[j-1].end);
+			i = j;
+		}
+	}
+	///Number of bytes of the input in blocks that contain kind
+	osmpbf::OffsetType dataSize(Kind kind) const {
+		osmpbf::OffsetType result = 0;
+		for(const Block & block : m_blocks) {
+			if (block.kinds & kind) {
+				result += block.end - block.begin;
+			}
+		}
+		return result;
+	}
+private:
+	struct Block {
+		osmpbf::OffsetType begin;
+		osmpbf::OffsetType end;
+		uint8_t kinds;
+	};
+private:
+	std::vector<Block> m_blocks;
+	bool m_valid{false};
+};
+
+namespace detail {
+namespace BlockParser {
+
+///@return the result of consumer(args...) if it returns a bool, true otherwise
+template<typename TConsumer, typename... TArgs>
+inline bool consume(TConsumer & consumer, TArgs && ... args) {
+	if constexpr (std::is_same<decltype(consumer(std::forward<TArgs>(args)...)), bool>::value) {
+		return consumer(std::forward<TArgs>(args)...);
+	}
+	else {
+		consumer(std::forward<TArgs>(args)...);
+		return true;
+	}
+}
+
+}}//end namespace detail::BlockParser
+
+/**
+ * Decodes the blocks of inFile on threadCount worker threads and hands the results
+ * to the consumer on the calling thread in the order the blocks appear in the file.
+ *
+ * decoder(osmpbf::PrimitiveBlockInputAdaptor & pbi, TBatch & batch) is called on a worker thread
+ * with a cleared batch and has to be thread-safe.
+ * consumer(TBatch & batch, osmpbf::OffsetType blockBegin, osmpbf::OffsetType blockEnd) is called on the calling thread,
+ * blockBegin and blockEnd are the positions of inFile before and after reading the block.
+ * Reading stops at the first block starting at or after dataEnd.
+ * If the consumer returns a bool then reading stops as soon as it returns false.
+ *
+ * At most 4*threadCount decoded blocks are kept in memory.
+ * TBatch needs to be default constructible, swappable and provide clear().
+ */
+template<typename TBatch, typename TDecoder, typename TConsumer>
+void parseBlocksOrdered(osmpbf::PbiStream & inFile, uint32_t threadCount, TDecoder decoder, TConsumer consumer,
+						osmpbf::OffsetType dataEnd = std::numeric_limits<osmpbf::OffsetType>::max())
+{
+	struct Slot {
+		TBatch batch;
+		osmpbf::OffsetType blockBegin{0};
+		osmpbf::OffsetType blockEnd{0};
+		bool full{false};
+	};
+
+	const uint64_t window = 4*uint64_t(std::max<uint32_t>(threadCount, 1));
+	std::vector<Slot> slots(window);
+	std::mutex readMtx; //guards inFile and nextSeq
+	std::mutex mtx; //guards slots, consumed, abort and error
+	//endSeq is only changed while holding both locks
+	std::condition_variable cv;
+	uint64_t nextSeq = 0;
+	uint64_t consumed = 0;
+	uint64_t endSeq = std::numeric_limits<uint64_t>::max();
+	bool abort = false;
+	std::exception_ptr error;
+
+	auto setError = [&](std::exception_ptr e) {
+		std::unique_lock<std::mutex> lck(mtx);
+		if (!error) {
+			error = e;
+		}
+		abort = true;
+		cv.notify_all();
+	};
+
+	auto workFunc = [&]() {
+		osmpbf::BlobDataBuffer buffer;
+		osmpbf::PrimitiveBlockInputAdaptor pbi;
+		TBatch batch;
+		try {
+			while (true) {
+				uint64_t seq;
+				osmpbf::OffsetType blockBegin;
+				osmpbf::OffsetType blockEnd;
+				{
+					std::unique_lock<std::mutex> rlck(readMtx);
+					seq = nextSeq;
+					if (seq >= endSeq) {
+						break;
+					}
+					{ //don't run too far ahead of the consumer
+						std::unique_lock<std::mutex> lck(mtx);
+						cv.wait(lck, [&]() { return abort || seq < consumed + window; });
+						if (abort) {
+							break;
+						}
+					}
+					blockBegin = inFile.dataPosition();
+					if (blockBegin >= dataEnd || !inFile.getNextBlock(buffer)) {
+						std::unique_lock<std::mutex> lck(mtx);
+						endSeq = seq;
+						cv.notify_all();
+						break;
+					}
+					++nextSeq;
+					blockEnd = inFile.dataPosition();
+				}
+				batch.clear();
+				pbi.parseData(buffer.data, buffer.availableBytes);
+				decoder(pbi, batch);
+				{
+					std::unique_lock<std::mutex> lck(mtx);
+					Slot & slot = slots[seq % window];
+					using std::swap;
+					swap(slot.batch, batch);
+					slot.blockBegin = blockBegin;
+					slot.blockEnd = blockEnd;
+					slot.full = true;
+				}
+				cv.notify_all();
+			}
+		}
+		catch (...) {
+			setError(std::current_exception());
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(uint32_t i(0); i < std::max<uint32_t>(threadCount, 1); ++i) {
+		workers.emplace_back(workFunc);
+	}
+
+	TBatch current;
+	try {
+		for(uint64_t seq(0); ; ++seq) {
+			osmpbf::OffsetType blockBegin;
+			osmpbf::OffsetType blockEnd;
+			{
+				std::unique_lock<std::mutex> lck(mtx);
+				Slot & slot = slots[seq % window];
+				cv.wait(lck, [&]() { return abort || slot.full || seq >= endSeq; });
+				if (abort || !slot.full) {
+					break;
+				}
+				using std::swap;
+				swap(slot.batch, current);
+				blockBegin = slot.blockBegin;
+				blockEnd = slot.blockEnd;
+				slot.full = false;
+				++consumed;
+			}
+			cv.notify_all();
+			if (!detail::BlockParser::consume(consumer, current, blockBegin, blockEnd)) {
+				std::unique_lock<std::mutex> lck(mtx);
+				abort = true;
+				cv.notify_all();
+				break;
+			}
+		}
+	}
+	catch (...) {
+		setError(std::current_exception());
+	}
+
+	for(std::thread & t : workers) {
+		t.join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+}}}//end namespace
+
+#endif
@@ -0,0 +1,201 @@
+#include "ComponentContainer.h"
+#include "Encoding.h"
+#include "TempFile.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+namespace {
+
+constexpr std::size_t ChunkSize = std::size_t(1) << 16;
+
+} //end namespace
+
+constexpr char ComponentContainerWriter::Magic[9];
+
+///Collects the data of a component in memory or in a temporary file if it exceeds the memory limit
+class ComponentContainerWriter::ComponentStream: public std::ostream {
+public:
+	ComponentStream(const std::string & tempDirectory, std::size_t memoryLimit) :
+	std::ostream(nullptr),
+	m_buffer(tempDirectory, memoryLimit)
+	{
+		rdbuf(&m_buffer);
+	}
+	///writes the collected data to out and returns its size
+	uint64_t copyTo(std::ostream & out) { return m_buffer.copyTo(out); }
+private:
+	class Buffer: public std::streambuf {
+	public:
+		Buffer(const std::string & tempDirectory, std::size_t memoryLimit) :
+		m_tempDirectory(tempDirectory),
+		m_memoryLimit(memoryLimit),
+		m_chunk(ChunkSize)
+		{
+			setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+		}
+		~Buffer() override {
+			if (m_file) {
+				::fclose(m_file);
+			}
+		}
+		uint64_t copyTo(std::ostream & out) {
+			if (m_failed) {
+				throw std::runtime_error("ComponentContainerWriter: could not store component in " + m_tempDirectory);
+			}
+			store();
+			if (!m_file) {
+				out.write(m_data.data(), m_data.size());
+			}
+			else {
+				if (::fflush(m_file) != 0 || ::fseek(m_file, 0, SEEK_SET) != 0) {
+					throw std::runtime_error("ComponentContainerWriter: could not read temporary file");
+				}
+				for(uint64_t remaining(m_size); remaining;) {
+					std::size_t len = std::min<uint64_t>(remaining, m_chunk.size());
+					if (::fread(m_chunk.data(), 1, len, m_file) != len) {
+						throw std::runtime_error("ComponentContainerWriter: could not read temporary file");
+					}
+					out.write(m_chunk.data(), len);
+					remaining -= len;
+				}
+			}
+			if (!out) {
+				throw std::runtime_error("ComponentContainerWriter: could not write component");
+			}
+			return m_size;
+		}
+	protected:
+		int_type overflow(int_type ch) override {
+			if (!tryStore()) {
+				return traits_type::eof();
+			}
+			if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+				*pptr() = traits_type::to_char_type(ch);
+				pbump(1);
+			}
+			return traits_type::not_eof(ch);
+		}
+		int sync() override {
+			return tryStore() ? 0 : -1;
+		}
+	private:
+		bool tryStore() {
+			try {
+				store();
+			}
+			catch (const std::exception &) {
+				m_failed = true;
+			}
+			return !m_failed;
+		}
+		///moves the data of the put area to m_data or the temporary file
+		void store() {
+			std::size_t len = pptr() - pbase();
+			if (!m_file && m_data.size() + len > m_memoryLimit) {
+				m_file = openUnlinkedTempFile(m_tempDirectory, "osmgraphcreator-component");
+				write(m_data.data(), m_data.size());
+				m_data = std::vector<char>();
+			}
+			if (m_file) {
+				write(pbase(), len);
+			}
+			else {
+				m_data.insert(m_data.end(), pbase(), pptr());
+			}
+			m_size += len;
+			setp(m_chunk.data(), m_chunk.data() + m_chunk.size());
+		}
+		void write(const char * data, std::size_t size) {
+			if (size && ::fwrite(data, 1, size, m_file) != size) {
+				throw std::runtime_error("ComponentContainerWriter: could not write temporary file");
+			}
+		}
+	private:
+		std::string m_tempDirectory;
+		std::size_t m_memoryLimit;
+		std::vector<char> m_chunk;
+		std::vector<char> m_data;
+		FILE * m_file{0};
+		uint64_t m_size{0};
+		bool m_failed{false};
+	};
+private:
+	Buffer m_buffer;
+};
+
+ComponentContainerWriter::ComponentContainerWriter(std::shared_ptr<std::ostream> out, uint64_t flags, const std::string & tempDirectory, std::size_t memoryLimit) :
+m_out(out),
+m_flags(flags),
+m_tempDirectory(tempDirectory),
+m_memoryLimit(memoryLimit)
+{}
+
+ComponentContainerWriter::~ComponentContainerWriter() {
+	try {
+		finish();
+	}
+	catch (const std::exception &) {}
+}
+
+std::shared_ptr<std::ostream> ComponentContainerWriter::component(uint64_t ccId, uint64_t nodeCount, uint64_t edgeCount) {
+	Entry entry{ccId, nodeCount, edgeCount, 0, 0};
+	ComponentStream * stream = new ComponentStream(m_tempDirectory, m_memoryLimit);
+	//stream errors are reported by finish() since the deleter is usually called by a destructor
+	return std::shared_ptr<std::ostream>(stream, [this, entry](std::ostream * s) {
+		ComponentStream * stream = static_cast<ComponentStream*>(s);
+		try {
+			append(*stream, entry);
+		}
+		catch (const std::exception & e) {
+			std::lock_guard<std::mutex> lck(m_mtx);
+			if (m_error.empty()) {
+				m_error = e.what();
+			}
+		}
+		delete stream;
+	});
+}
+
+void ComponentContainerWriter::append(ComponentStream & stream, Entry entry) {
+	stream.flush();
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (m_finished) {
+		throw std::runtime_error("ComponentContainerWriter: component released after finish()");
+	}
+	entry.offset = m_offset;
+	entry.size = stream.copyTo(*m_out);
+	m_offset += entry.size;
+	m_entries.push_back(entry);
+}
+
+void ComponentContainerWriter::finish() {
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (m_finished) {
+		return;
+	}
+	m_finished = true;
+	std::sort(m_entries.begin(), m_entries.end(), [](const Entry & a, const Entry & b) { return a.ccId < b.ccId; });
+	for(const Entry & e : m_entries) {
+		putBigEndian(*m_out, e.ccId);
+		putBigEndian(*m_out, e.nodeCount);
+		putBigEndian(*m_out, e.edgeCount);
+		putBigEndian(*m_out, e.offset);
+		putBigEndian(*m_out, e.size);
+	}
+	putBigEndian(*m_out, m_entries.size());
+	putBigEndian(*m_out, m_flags);
+	m_out->write(Magic, 8);
+	m_out->flush();
+	if (m_error.size()) {
+		throw std::runtime_error(m_error);
+	}
+	if (!*m_out) {
+		throw std::runtime_error("ComponentContainerWriter: could not write the index");
+	}
+}
+
+}}}//end namespace
@@ -0,0 +1,67 @@
+#ifndef OSM_GRAPH_TOOLS_COMPONENT_CONTAINER_H
+#define OSM_GRAPH_TOOLS_COMPONENT_CONTAINER_H
+#include <cstdio>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * Writes many graphs, e.g. the connected components of CCGraphWriter, back to back into a single file.
+ *
+ * File format, all numbers are big endian uint64_t:
+ * --------------------------------------------------------------------------------------------------------
+ * DATA OF ALL COMPONENTS|(CCID|NODECOUNT|EDGECOUNT|OFFSET|SIZE)*ENTRYCOUNT|ENTRYCOUNT|FLAGS|"OGCCONT1"
+ * --------------------------------------------------------------------------------------------------------
+ * The data of a component is exactly the output of its graph writer, OFFSET is relative to the begin of the file.
+ * Entries of the footer are sorted by CCID. Bit 0 of FLAGS is set if the data of every component is gzip compressed.
+ */
+class ComponentContainerWriter {
+public:
+	static constexpr char Magic[9] = "OGCCONT1";
+	static constexpr uint64_t FlagGzip = 0x1;
+	///components larger than this are kept in a temporary file until they are appended
+	static constexpr std::size_t DefaultMemoryLimit = std::size_t(64) << 20;
+public:
+	ComponentContainerWriter(std::shared_ptr<std::ostream> out, uint64_t flags, const std::string & tempDirectory, std::size_t memoryLimit = DefaultMemoryLimit);
+	///calls finish()
+	~ComponentContainerWriter();
+	///Returns a stream for the data of a component.
+	///The data is appended to the container as soon as the last reference to the stream is released.
+	///This function is thread-safe and components may be written concurrently.
+	std::shared_ptr<std::ostream> component(uint64_t ccId, uint64_t nodeCount, uint64_t edgeCount);
+	///Writes the footer. All streams returned by component() have to be released before
+	void finish();
+private:
+	struct Entry {
+		uint64_t ccId;
+		uint64_t nodeCount;
+		uint64_t edgeCount;
+		uint64_t offset;
+		uint64_t size;
+	};
+	class ComponentStream;
+private:
+	void append(ComponentStream & stream, Entry entry);
+private:
+	std::shared_ptr<std::ostream> m_out;
+	uint64_t m_flags;
+	std::string m_tempDirectory;
+	std::size_t m_memoryLimit;
+	std::mutex m_mtx;
+	uint64_t m_offset{0};
+	std::vector<Entry> m_entries;
+	bool m_finished{false};
+	std::string m_error; ///first error of a component, reported by finish()
+};
+
+}}}//end namespace
+
+#endif
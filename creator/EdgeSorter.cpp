@@ -0,0 +1,178 @@
+#include "EdgeSorter.h"
+#include "Parallel.h"
+#include "TempFile.h"
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+namespace {
+
+constexpr std::size_t RunFileBufferSize = 1 << 20;
+///below this number of edges std::sort is faster than the radix sort
+constexpr std::size_t RadixSortThreshold = 1 << 16;
+
+inline uint64_t sortKey(const Edge & e) {
+	return (uint64_t(e.source) << 32) | e.target;
+}
+
+} //end namespace
+
+class EdgeSorter::RunReader {
+public:
+	RunReader(const Run & run) : m_file(run.file), m_remaining(run.size) {
+		if (::fseek(m_file, 0, SEEK_SET) != 0) {
+			throw std::runtime_error("EdgeSorter: could not read run");
+		}
+	}
+	inline const Edge & edge() const { return m_edge; }
+	inline Edge & edge() { return m_edge; }
+	///@return false if the run has no more edges
+	bool next() {
+		if (!m_remaining) {
+			return false;
+		}
+		uint32_t d[6];
+		if (::fread(d, sizeof(uint32_t), 6, m_file) != 6) {
+			throw std::runtime_error("EdgeSorter: could not read run");
+		}
+		m_edge = Edge(d[0], d[1], d[2], d[3], d[4]);
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		m_edge.tags.resize(d[5]);
+		if (d[5] && ::fread(&m_edge.tags[0], 1, d[5], m_file) != d[5]) {
+			throw std::runtime_error("EdgeSorter: could not read run");
+		}
+		#endif
+		--m_remaining;
+		return true;
+	}
+private:
+	FILE * m_file;
+	uint64_t m_remaining;
+	Edge m_edge;
+};
+
+EdgeSorter::EdgeSorter(uint32_t threadCount, uint64_t memoryBudget, const std::string & tempDirectory) :
+m_threadCount(std::max<uint32_t>(threadCount, 1)),
+m_memoryBudget(memoryBudget),
+m_tempDirectory(tempDirectory)
+{}
+
+EdgeSorter::~EdgeSorter() {
+	for(Run & run : m_runs) {
+		::fclose(run.file);
+	}
+}
+
+void EdgeSorter::reserve(uint64_t count) {
+	m_edges.reserve(std::min<uint64_t>(count, m_memoryBudget/(2*sizeof(Edge))));
+}
+
+void EdgeSorter::add(const Edge & edge) {
+	uint64_t usage = memoryUsage(edge);
+	//Growing m_edges copies it while the old storage is still allocated.
+	//Hence a run is written before if the grown vector and the buffer of the radix sort would exceed the budget
+	bool full = m_edges.size() == m_edges.capacity() && 4*std::max<uint64_t>(m_edges.capacity(), 1)*sizeof(Edge) > m_memoryBudget;
+	if (m_edges.size() && (full || m_memoryUsage + usage > m_memoryBudget)) {
+		writeRun();
+	}
+	m_memoryUsage += usage;
+	m_edges.push_back(edge);
+}
+
+void EdgeSorter::add(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		add(edges[i]);
+	}
+}
+
+void EdgeSorter::sort() {
+	if (m_edges.size() < RadixSortThreshold) {
+		std::stable_sort(m_edges.begin(), m_edges.end(), [](const Edge & a, const Edge & b) {
+			return sortKey(a) < sortKey(b);
+		});
+	}
+	else {
+		radixSort(m_edges, m_buffer, m_threadCount, sortKey, RadixSortThreshold);
+	}
+	m_buffer = std::vector<Edge>();
+}
+
+void EdgeSorter::writeRun() {
+	FILE * file = openUnlinkedTempFile(m_tempDirectory, "osmgraphcreator-edges");
+	m_runs.push_back(Run{file, m_edges.size()});
+	::setvbuf(file, 0, _IOFBF, RunFileBufferSize);
+	sort();
+	for(const Edge & e : m_edges) {
+		uint32_t d[6] = {e.source, e.target, uint32_t(e.weight), uint32_t(e.type), uint32_t(e.maxspeed), 0};
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		d[5] = e.tags.size();
+		#endif
+		bool ok = ::fwrite(d, sizeof(uint32_t), 6, file) == 6;
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		ok = ok && ::fwrite(e.tags.data(), 1, e.tags.size(), file) == e.tags.size();
+		#endif
+		if (!ok) {
+			throw std::runtime_error("EdgeSorter: could not write run");
+		}
+	}
+	if (::fflush(file) != 0) {
+		throw std::runtime_error("EdgeSorter: could not write run");
+	}
+	m_edges.clear();
+	m_memoryUsage = 0;
+}
+
+void EdgeSorter::finish(const std::function<void(const Edge *, std::size_t)> & consumer) {
+	if (m_runs.empty()) {
+		sort();
+		for(std::size_t i(0), s(m_edges.size()); i < s; i += BatchSize) {
+			consumer(m_edges.data()+i, std::min(BatchSize, s-i));
+		}
+	}
+	else {
+		if (m_edges.size()) {
+			writeRun();
+		}
+		m_edges = std::vector<Edge>();
+		//k-way merge, edges with the same key are taken from the earlier run first which keeps the sort stable
+		std::vector<RunReader> readers;
+		readers.reserve(m_runs.size());
+		typedef std::pair<uint64_t, std::size_t> HeapEntry; //(key, run)
+		std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+		for(const Run & run : m_runs) {
+			readers.emplace_back(run);
+			if (readers.back().next()) {
+				heap.emplace(sortKey(readers.back().edge()), readers.size()-1);
+			}
+		}
+		std::vector<Edge> batch;
+		batch.reserve(BatchSize);
+		while (heap.size()) {
+			std::size_t run = heap.top().second;
+			heap.pop();
+			batch.push_back(std::move(readers[run].edge()));
+			if (batch.size() == BatchSize) {
+				consumer(batch.data(), batch.size());
+				batch.clear();
+			}
+			if (readers[run].next()) {
+				heap.emplace(sortKey(readers[run].edge()), run);
+			}
+		}
+		if (batch.size()) {
+			consumer(batch.data(), batch.size());
+		}
+		for(Run & run : m_runs) {
+			::fclose(run.file);
+		}
+		m_runs.clear();
+	}
+	m_edges = std::vector<Edge>();
+	m_memoryUsage = 0;
+}
+
+}}}//end namespace
@@ -0,0 +1,67 @@
+#ifndef OSM_GRAPH_TOOLS_EDGE_SORTER_H
+#define OSM_GRAPH_TOOLS_EDGE_SORTER_H
+#include "types.h"
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * Sorts edges by (source, target) within a memory budget.
+ * Edges are collected in memory and sorted by a parallel LSD radix sort.
+ * If the collected edges and the buffer of the radix sort exceed the memory budget then the sorted edges are written
+ * as a run to a temporary file. In the end all runs are merged.
+ * The sort is stable, i.e. edges with the same source and target keep the order in which they were added.
+ *
+ * Run files are unlinked directly after creation, hence they are removed by the system as soon as the sorter is destroyed.
+ */
+class EdgeSorter {
+public:
+	///@param memoryBudget in bytes
+	///@param tempDirectory directory of the run files
+	EdgeSorter(uint32_t threadCount, uint64_t memoryBudget, const std::string & tempDirectory);
+	~EdgeSorter();
+	///reserves memory for count edges without exceeding the memory budget
+	void reserve(uint64_t count);
+	void add(const Edge & edge);
+	void add(const Edge * edges, std::size_t count);
+	///Calls consumer(edges, count) for consecutive batches of the sorted edges and removes all edges from the sorter
+	void finish(const std::function<void(const Edge *, std::size_t)> & consumer);
+private:
+	struct Run {
+		FILE * file;
+		uint64_t size;
+	};
+	class RunReader;
+private:
+	static constexpr std::size_t BatchSize = 4096;
+	///sorts m_edges in memory
+	void sort();
+	///sorts m_edges and writes them to a new run
+	void writeRun();
+	///memory usage of an edge including the buffer of the radix sort
+	static inline uint64_t memoryUsage(const Edge & edge) {
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		return 2*sizeof(Edge) + edge.tags.size();
+		#else
+		(void) edge;
+		return 2*sizeof(Edge);
+		#endif
+	}
+private:
+	uint32_t m_threadCount;
+	uint64_t m_memoryBudget;
+	std::string m_tempDirectory;
+	std::vector<Edge> m_edges;
+	std::vector<Edge> m_buffer; ///buffer of the radix sort
+	uint64_t m_memoryUsage{0};
+	std::vector<Run> m_runs;
+};
+
+}}}//end namespace
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef OSM_GRAPH_TOOLS_ENCODING_H
+#define OSM_GRAPH_TOOLS_ENCODING_H
+#include <stdint.h>
+#include <ostream>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+///writes the lowest bytes bytes of v in big endian order
+inline void putBigEndian(std::ostream & out, uint64_t v, int bytes = 8) {
+	char d[8];
+	for(int i(0); i < bytes; ++i) {
+		d[i] = char(v >> (8*(bytes-1-i)));
+	}
+	out.write(d, bytes);
+}
+
+///appends v as LEB128 varint
+inline void putVarUInt(std::vector<uint8_t> & dest, uint64_t v) {
+	while (v >= 0x80) {
+		dest.push_back(uint8_t(v) | 0x80);
+		v >>= 7;
+	}
+	dest.push_back(uint8_t(v));
+}
+
+///appends v zigzag encoded as LEB128 varint
+inline void putVarSInt(std::vector<uint8_t> & dest, int64_t v) {
+	putVarUInt(dest, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+///@return false if [it, end) does not start with a complete varint
+inline bool getVarUInt(const uint8_t * & it, const uint8_t * end, uint64_t & v) {
+	v = 0;
+	for(int shift = 0; it != end && shift < 64; shift += 7) {
+		uint8_t b = *it;
+		++it;
+		v |= uint64_t(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool getVarSInt(const uint8_t * & it, const uint8_t * end, int64_t & v) {
+	uint64_t tmp;
+	if (!getVarUInt(it, end, tmp)) {
+		return false;
+	}
+	v = int64_t(tmp >> 1) ^ -int64_t(tmp & 1);
+	return true;
+}
+
+}}}//end namespace
+
+#endif
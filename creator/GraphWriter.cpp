@@ -1,4 +1,7 @@
 #include "GraphWriter.h"
+#include "Encoding.h"
+#include "Parallel.h"
+#include "TempFile.h"
 /* uint*_t */
 #include <stdint.h>
 /* memcpy */
@@ -7,6 +10,9 @@
 #include <type_traits>
 #include <functional>
 #include <limits>
+#include <atomic>
+#include <exception>
+#include <mutex>
 
 /* make sure be32toh and be64toh are present */
 #if defined(__linux__)
@@ -41,12 +47,69 @@ static uint64_t my_htobe64(uint64_t x) {
 
 #endif
 #include <sserialize/stats/ProgressInfo.h>
-#include <sserialize/containers/UnionFind.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 
 namespace osm {
 namespace graphtools {
 namespace creator {
+
+//BEGIN OutputBuffer
+OutputBuffer::OutputBuffer(std::shared_ptr<std::ostream> out, int precision, std::size_t capacity) :
+m_out(out),
+m_data(new (std::align_val_t(Alignment)) char[capacity]),
+m_capacity(capacity),
+m_precision(precision)
+{}
+
+OutputBuffer::~OutputBuffer() {
+	flush();
+}
+
+void OutputBuffer::flush() {
+	if (m_size) {
+		m_out->write(m_data.get(), m_size);
+		m_size = 0;
+	}
+}
+
+void OutputBuffer::putText(double v) {
+	while (true) {
+		char * begin = m_data.get()+m_size;
+		char * end = m_data.get()+m_capacity;
+		std::to_chars_result result;
+		if (m_precision == ShortestPrecision) {
+			result = std::to_chars(begin, end, v, std::chars_format::fixed);
+		}
+		else {
+			result = std::to_chars(begin, end, v, std::chars_format::fixed, m_precision);
+		}
+		if (result.ec == std::errc()) {
+			m_size = result.ptr - m_data.get();
+			return;
+		}
+		if (m_size == 0) {
+			throw std::runtime_error("OutputBuffer: could not format number");
+		}
+		flush();
+	}
+}
+//END OutputBuffer
+
+#ifdef CONFIG_CREATOR_FIXED_POINT_COORDINATES
+void
+GraphWriter::writeNodes(const Node * nodes, const StoredCoordinates * coordinates, std::size_t count) {
+	constexpr std::size_t BatchSize = 4096;
+	std::vector<Coordinates> tmp(std::min(count, BatchSize));
+	for(std::size_t i(0); i < count; i += BatchSize) {
+		std::size_t s = std::min(BatchSize, count-i);
+		std::copy(coordinates+i, coordinates+i+s, tmp.begin());
+		writeNodes(nodes+i, tmp.data(), s);
+	}
+}
+#endif
 	
 void
 DropGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
@@ -84,37 +147,58 @@ DropGraphWriter::endGraph() {
 }
 
 //BEGIN TopologyTextGraphWriter
-TopologyTextGraphWriter::TopologyTextGraphWriter(std::shared_ptr<std::ostream> out) :  m_out(out) {}
+TopologyTextGraphWriter::TopologyTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision) :  m_buffer(out, coordinatePrecision) {}
 TopologyTextGraphWriter::~TopologyTextGraphWriter(){}
 
+void TopologyTextGraphWriter::endGraph() {
+	m_buffer.flush();
+}
+
 void TopologyTextGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
 	out() << nodeCount << "\n";
 	out() << edgeCount << "\n";
 }
 
 void TopologyTextGraphWriter::writeNode(const osm::graphtools::creator::Node & /*node*/, const osm::graphtools::creator::Coordinates & coordinates) {
-	out() << coordinates.lat << " " << coordinates.lon << "\n";
+	m_buffer.putText(coordinates.lat);
+	m_buffer.put(' ');
+	m_buffer.putText(coordinates.lon);
+	m_buffer.put('\n');
 }
 
 void TopologyTextGraphWriter::writeEdge(const Edge & e) {
-	out() << e.source << " " << e.target << "\n";
+	m_buffer.putText(e.source);
+	m_buffer.put(' ');
+	m_buffer.putText(e.target);
+	m_buffer.put('\n');
+}
+
+void TopologyTextGraphWriter::writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		TopologyTextGraphWriter::writeNode(nodes[i], coordinates[i]);
+	}
+}
+
+void TopologyTextGraphWriter::writeEdges(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		TopologyTextGraphWriter::writeEdge(edges[i]);
+	}
 }
 //END TopologyTextGraphWriter
 //BEGIN TopologyBinaryGraphWriter
-TopologyBinaryGraphWriter::TopologyBinaryGraphWriter(std::shared_ptr<std::ostream> out) :  m_out(out) {}
+TopologyBinaryGraphWriter::TopologyBinaryGraphWriter(std::shared_ptr<std::ostream> out) :  m_buffer(out) {}
 TopologyBinaryGraphWriter::~TopologyBinaryGraphWriter(){}
 
 void TopologyBinaryGraphWriter::putUnsignedLong(uint64_t v) {
-	v = htole64(v);
-	char tmp[sizeof(v)];
-	memcpy(tmp, &v, sizeof(v));
-	out().write(tmp, sizeof(v));
+	m_buffer.putRaw<uint64_t>(htole64(v));
 }
 
 void TopologyBinaryGraphWriter::putDouble(double v) {
-	char tmp[sizeof(v)];
-	memcpy(tmp, &v, sizeof(v));
-	out().write(tmp, sizeof(v));
+	m_buffer.putRaw(v);
+}
+
+void TopologyBinaryGraphWriter::endGraph() {
+	m_buffer.flush();
 }
 
 void TopologyBinaryGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
@@ -131,7 +215,19 @@ void TopologyBinaryGraphWriter::writeEdge(const Edge & e) {
 	putUnsignedLong(e.source);
 	putUnsignedLong(e.target);
 }
-//END TopologyTextGraphWriter
+
+void TopologyBinaryGraphWriter::writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		TopologyBinaryGraphWriter::writeNode(nodes[i], coordinates[i]);
+	}
+}
+
+void TopologyBinaryGraphWriter::writeEdges(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		TopologyBinaryGraphWriter::writeEdge(edges[i]);
+	}
+}
+//END TopologyBinaryGraphWriter
 
 // # Id : [hexstring]
 // # Timestamp : [int]
@@ -139,9 +235,13 @@ void TopologyBinaryGraphWriter::writeEdge(const Edge & e) {
 // # Revision: 1
 
 
-FmiTextGraphWriter::FmiTextGraphWriter(std::shared_ptr<std::ostream> out) :  m_out(out) {}
+FmiTextGraphWriter::FmiTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision) :  m_buffer(out, coordinatePrecision) {}
 FmiTextGraphWriter::~FmiTextGraphWriter(){}
 
+void FmiTextGraphWriter::endGraph() {
+	m_buffer.flush();
+}
+
 void FmiTextGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
 	out() << "# Id : 0\n";
 	out() << "# Timestamp : " << time(0) << "\n";
@@ -151,23 +251,59 @@ void FmiTextGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
 	out() << edgeCount << "\n";
 }
 
-void FmiTextGraphWriter::writeNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
-	out() << node.id << " " << node.osmId << " " << coordinates.lat << " " << coordinates.lon << " " << node.elev;
+void FmiTextGraphWriter::putNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
+	m_buffer.putText(node.id);
+	m_buffer.put(' ');
+	m_buffer.putText(node.osmId);
+	m_buffer.put(' ');
+	m_buffer.putText(coordinates.lat);
+	m_buffer.put(' ');
+	m_buffer.putText(coordinates.lon);
+	m_buffer.put(' ');
+	m_buffer.putText(node.elev);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-		out() << " " << node.tags;
+	m_buffer.put(' ');
+	m_buffer.put(node.tags.data(), node.tags.size());
 #endif
-	out() << '\n';
+	m_buffer.put('\n');
 }
 
-void FmiTextGraphWriter::writeEdge(const Edge & e) {
-	out() << e.source << " " << e.target << " " << e.weight << " " << e.type;
+void FmiTextGraphWriter::putEdge(const Edge & e) {
+	m_buffer.putText(e.source);
+	m_buffer.put(' ');
+	m_buffer.putText(e.target);
+	m_buffer.put(' ');
+	m_buffer.putText(e.weight);
+	m_buffer.put(' ');
+	m_buffer.putText(e.type);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-	out() << " " << e.tags;
+	m_buffer.put(' ');
+	m_buffer.put(e.tags.data(), e.tags.size());
 #endif
-	out() << '\n';
+	m_buffer.put('\n');
+}
+
+void FmiTextGraphWriter::writeNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
+	putNode(node, coordinates);
+}
+
+void FmiTextGraphWriter::writeEdge(const Edge & e) {
+	putEdge(e);
+}
+
+void FmiTextGraphWriter::writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		putNode(nodes[i], coordinates[i]);
+	}
+}
+
+void FmiTextGraphWriter::writeEdges(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		putEdge(edges[i]);
+	}
 }
 
-FmiMaxSpeedTextGraphWriter::FmiMaxSpeedTextGraphWriter(std::shared_ptr<std::ostream> out) : FmiTextGraphWriter(out) {}
+FmiMaxSpeedTextGraphWriter::FmiMaxSpeedTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision) : FmiTextGraphWriter(out, coordinatePrecision) {}
 FmiMaxSpeedTextGraphWriter::~FmiMaxSpeedTextGraphWriter() {}
 
 void FmiMaxSpeedTextGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
@@ -179,37 +315,47 @@ void FmiMaxSpeedTextGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCo
 	out() << edgeCount << "\n";
 }
 
-void FmiMaxSpeedTextGraphWriter::writeEdge(const Edge & e) {
-	out() << e.source << " " << e.target << " " << e.weight << " " << e.type << " " << e.maxspeed;
+void FmiMaxSpeedTextGraphWriter::putEdge(const Edge & e) {
+	buffer().putText(e.source);
+	buffer().put(' ');
+	buffer().putText(e.target);
+	buffer().put(' ');
+	buffer().putText(e.weight);
+	buffer().put(' ');
+	buffer().putText(e.type);
+	buffer().put(' ');
+	buffer().putText(e.maxspeed);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-	out() << " " << e.tags;
+	buffer().put(' ');
+	buffer().put(e.tags.data(), e.tags.size());
 #endif
-	out() << "\n";
+	buffer().put('\n');
 }
 
-FmiBinaryGraphWriter::FmiBinaryGraphWriter(std::shared_ptr<std::ostream> out) :  m_out(out) {}
+FmiBinaryGraphWriter::FmiBinaryGraphWriter(std::shared_ptr<std::ostream> out) :  m_buffer(out) {}
 
 
 FmiBinaryGraphWriter::~FmiBinaryGraphWriter() {}
 
 void FmiBinaryGraphWriter::putInt(int32_t v) {
-	v = htobe32(v);
-	char tmp[sizeof(v)];
-	memcpy(tmp, &v, sizeof(v));
-	out().write(tmp, sizeof(v));
+	m_buffer.putRaw<uint32_t>(htobe32(v));
 }
 
 void FmiBinaryGraphWriter::putLong(int64_t v) {
-	v = htobe64(v);
-	char tmp[sizeof(v)];
-	memcpy(tmp, &v, sizeof(v));
-	out().write(tmp, sizeof(v));
+	m_buffer.putRaw<uint64_t>(htobe64(v));
 }
 
 void FmiBinaryGraphWriter::putDouble(double v) {
-	char tmp[sizeof(v)];
-	memcpy(tmp, &v, sizeof(v));
-	out().write(tmp, sizeof(v));
+	m_buffer.putRaw(v);
+}
+
+void FmiBinaryGraphWriter::putString(const std::string & v) {
+	putInt(v.size());
+	m_buffer.put(v.data(), v.size());
+}
+
+void FmiBinaryGraphWriter::endGraph() {
+	m_buffer.flush();
 }
 
 void FmiBinaryGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
@@ -221,33 +367,51 @@ void FmiBinaryGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
 	putInt(edgeCount);
 }
 
-void FmiBinaryGraphWriter::writeNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
+void FmiBinaryGraphWriter::putNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
 	putInt(node.id);
 	putLong(node.osmId);
 	putDouble(coordinates.lat);
 	putDouble(coordinates.lon);
 	putInt(node.elev);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-	putInt(node.tags.size());
-	out().write(node.tags.c_str(), node.tags.size());
+	putString(node.tags);
 #else
 	putInt(0);
 #endif
 }
 
-void FmiBinaryGraphWriter::writeEdge(const Edge & e) {
+void FmiBinaryGraphWriter::putEdge(const Edge & e) {
 	putInt(e.source);
 	putInt(e.target);
 	putInt(e.weight);
 	putInt(e.type);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-	putInt(e.tags.size());
-	out().write(e.tags.c_str(), e.tags.size());
+	putString(e.tags);
 #else
 	putInt(0);
 #endif
 }
 
+void FmiBinaryGraphWriter::writeNode(const osm::graphtools::creator::Node & node, const osm::graphtools::creator::Coordinates & coordinates) {
+	putNode(node, coordinates);
+}
+
+void FmiBinaryGraphWriter::writeEdge(const Edge & e) {
+	putEdge(e);
+}
+
+void FmiBinaryGraphWriter::writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		putNode(nodes[i], coordinates[i]);
+	}
+}
+
+void FmiBinaryGraphWriter::writeEdges(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		putEdge(edges[i]);
+	}
+}
+
 
 FmiMaxSpeedBinaryGraphWriter::FmiMaxSpeedBinaryGraphWriter(std::shared_ptr<std::ostream> out) : FmiBinaryGraphWriter(out) {}
 FmiMaxSpeedBinaryGraphWriter::~FmiMaxSpeedBinaryGraphWriter() {}
@@ -261,20 +425,129 @@ void FmiMaxSpeedBinaryGraphWriter::writeHeader(uint64_t nodeCount, uint64_t edge
 	putInt(edgeCount);
 }
 
-void FmiMaxSpeedBinaryGraphWriter::writeEdge(const Edge & e) {
+void FmiMaxSpeedBinaryGraphWriter::putEdge(const Edge & e) {
 	putInt(e.source);
 	putInt(e.target);
 	putInt(e.weight);
 	putInt(e.type);
 	putInt(e.maxspeed);
 #ifdef CONFIG_CREATOR_COPY_TAGS
-	putInt(e.tags.size());
-	out().write(e.tags.c_str(), e.tags.size());
+	putString(e.tags);
 #else
 	putInt(0);
 #endif
 }
 
+//BEGIN PlacedEdgeWriter
+PlacedEdgeWriter::PlacedEdgeWriter(std::shared_ptr<GraphWriter> & baseGraphWriter, bool sortTargets, const std::string & tempDirectory) :
+m_baseGraphWriter(baseGraphWriter),
+m_sortTargets(sortTargets),
+m_tempDirectory(tempDirectory)
+{}
+
+PlacedEdgeWriter::~PlacedEdgeWriter() {
+	unmap();
+}
+
+void PlacedEdgeWriter::unmap() {
+	if (m_edges) {
+		::munmap(m_edges, m_edgeCount*sizeof(PlacedEdge));
+		m_edges = 0;
+	}
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+void PlacedEdgeWriter::setEdgeOffsets(std::vector<uint64_t> && offsets) {
+	unmap();
+	if (offsets.empty()) {
+		throw std::runtime_error("PlacedEdgeWriter: offsets need at least one entry");
+	}
+	m_offsets = std::move(offsets);
+	m_next.assign(m_offsets.begin(), m_offsets.end()-1);
+	m_edgeCount = m_offsets.back();
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	m_tags.assign(m_edgeCount, std::string());
+	#endif
+	if (!m_edgeCount) {
+		return;
+	}
+	m_fd = createUnlinkedTempFile(m_tempDirectory, "osmgraphcreator-edges");
+	if (::ftruncate(m_fd, m_edgeCount*sizeof(PlacedEdge)) != 0) {
+		throw std::runtime_error("PlacedEdgeWriter: could not resize edge file in " + m_tempDirectory);
+	}
+	void * data = ::mmap(0, m_edgeCount*sizeof(PlacedEdge), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (data == MAP_FAILED) {
+		throw std::runtime_error("PlacedEdgeWriter: could not map edge file");
+	}
+	m_edges = static_cast<PlacedEdge*>(data);
+}
+
+void PlacedEdgeWriter::writeEdge(const Edge & edge) {
+	if (edge.source >= m_next.size() || m_next[edge.source] >= m_offsets[edge.source+1]) {
+		throw std::runtime_error("PlacedEdgeWriter: edge does not match the edge offsets");
+	}
+	uint64_t pos = m_next[edge.source]++;
+	m_edges[pos] = PlacedEdge{edge.target, edge.weight, edge.type, edge.maxspeed};
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	m_tags[pos] = edge.tags;
+	#endif
+}
+
+void PlacedEdgeWriter::writeEdges(const Edge * edges, std::size_t count) {
+	for(std::size_t i(0); i < count; ++i) {
+		PlacedEdgeWriter::writeEdge(edges[i]);
+	}
+}
+
+void PlacedEdgeWriter::endEdges() {
+	constexpr std::size_t BatchSize = 4096;
+	for(std::size_t node(0), s(m_next.size()); node < s; ++node) {
+		if (m_next[node] != m_offsets[node+1]) {
+			throw std::runtime_error("PlacedEdgeWriter: less edges than given by the edge offsets");
+		}
+	}
+	m_baseGraphWriter->beginEdges();
+	std::vector<Edge> batch;
+	batch.reserve(BatchSize);
+	std::vector<uint32_t> order;
+	for(std::size_t node(0), s(m_next.size()); node < s; ++node) {
+		uint64_t begin = m_offsets[node];
+		uint64_t size = m_offsets[node+1] - begin;
+		order.resize(size);
+		for(uint32_t i(0); i < size; ++i) {
+			order[i] = i;
+		}
+		if (m_sortTargets && size > 1) {
+			std::stable_sort(order.begin(), order.end(), [this, begin](uint32_t a, uint32_t b) {
+				return m_edges[begin+a].target < m_edges[begin+b].target;
+			});
+		}
+		for(uint32_t i : order) {
+			const PlacedEdge & pe = m_edges[begin+i];
+			batch.emplace_back(node, pe.target, pe.weight, pe.type, pe.maxspeed);
+			#ifdef CONFIG_CREATOR_COPY_TAGS
+			batch.back().tags = std::move(m_tags[begin+i]);
+			#endif
+			if (batch.size() == BatchSize) {
+				m_baseGraphWriter->writeEdges(batch.data(), batch.size());
+				batch.clear();
+			}
+		}
+	}
+	m_baseGraphWriter->writeEdges(batch.data(), batch.size());
+	m_baseGraphWriter->endEdges();
+	unmap();
+	m_offsets = std::vector<uint64_t>();
+	m_next = std::vector<uint64_t>();
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	m_tags = std::vector<std::string>();
+	#endif
+}
+//END PlacedEdgeWriter
+
 #ifdef CONFIG_SUPPORT_SSERIALIZE_OFFSET_ARRAY_TARGET
 
 RamGraphWriter::RamGraphWriter(const sserialize::UByteArrayAdapter & data) : m_data(data), m_edgeBegin(0) {}
@@ -348,15 +621,160 @@ void StaticGraphWriter::writeEdge(const graphtools::creator::Edge & edge) {
 #endif
 
 
-CCGraphWriter::CCGraphWriter(GraphWriterFactory factory, FilterMode filter_mode, std::size_t filter_value) :
+namespace {
+
+///A lock-free union find on the ids [0, size) which allows concurrent calls of unite() and find().
+///Sets are linked by their smallest id, hence the representative of a set is its smallest id
+class ConcurrentUnionFind {
+public:
+	ConcurrentUnionFind(uint32_t size, uint32_t threadCount) : m_parent(size) {
+		parallelFor(threadCount, [this, size, threadCount](uint32_t thread) {
+			for(uint64_t i(uint64_t(size)*thread/threadCount), s(uint64_t(size)*(thread+1)/threadCount); i < s; ++i) {
+				m_parent[i].store(i, std::memory_order_relaxed);
+			}
+		});
+	}
+	uint32_t find(uint32_t x) {
+		while (true) {
+			uint32_t p = m_parent[x].load(std::memory_order_acquire);
+			if (p == x) {
+				return x;
+			}
+			//path halving, losing the race to another thread is harmless
+			uint32_t gp = m_parent[p].load(std::memory_order_acquire);
+			if (p != gp) {
+				m_parent[x].compare_exchange_weak(p, gp, std::memory_order_acq_rel);
+			}
+			x = gp;
+		}
+	}
+	void unite(uint32_t a, uint32_t b) {
+		while (true) {
+			a = find(a);
+			b = find(b);
+			if (a == b) {
+				return;
+			}
+			if (a < b) {
+				std::swap(a, b);
+			}
+			//link the larger root below the smaller one, fails if a is no root anymore
+			uint32_t expected = a;
+			if (m_parent[a].compare_exchange_strong(expected, b, std::memory_order_acq_rel)) {
+				return;
+			}
+		}
+	}
+private:
+	std::vector< std::atomic<uint32_t> > m_parent;
+};
+
+} //end namespace
+
+CCGraphWriter::CCGraphWriter(GraphWriterFactory factory, FilterMode filter_mode, std::size_t filter_value, uint32_t threadCount, bool strongComponents) :
 m_f(factory),
 m_filter_mode(filter_mode),
-m_filter_value(filter_value)
+m_filter_value(filter_value),
+m_threadCount(std::max<uint32_t>(threadCount, 1)),
+m_strongComponents(strongComponents)
 {}
 
 CCGraphWriter::~CCGraphWriter()
 {}
 
+void
+CCGraphWriter::weakComponents(std::vector<uint32_t> & label) const {
+	const uint32_t nodeCount = label.size();
+	const uint64_t edgeCount = m_edges.size();
+	const uint32_t threadCount = m_threadCount;
+	ConcurrentUnionFind uf(nodeCount, threadCount);
+	parallelFor(threadCount, [&](uint32_t thread) {
+		for(uint64_t i(edgeCount*thread/threadCount), s(edgeCount*(thread+1)/threadCount); i < s; ++i) {
+			uf.unite(m_edges[i].source, m_edges[i].target);
+		}
+	});
+	parallelFor(threadCount, [&](uint32_t thread) {
+		for(uint64_t i(uint64_t(nodeCount)*thread/threadCount), s(uint64_t(nodeCount)*(thread+1)/threadCount); i < s; ++i) {
+			label[i] = uf.find(i);
+		}
+	});
+}
+
+void
+CCGraphWriter::strongComponents(std::vector<uint32_t> & label) const {
+	constexpr uint32_t Unvisited = std::numeric_limits<uint32_t>::max();
+	const uint32_t nodeCount = label.size();
+	const uint64_t edgeCount = m_edges.size();
+	const uint32_t threadCount = m_threadCount;
+	//adjacency arrays of the graph, targets[offsets[v], offsets[v+1]) are the targets of v
+	std::vector<uint64_t> offsets(uint64_t(nodeCount)+1, 0);
+	std::vector<uint32_t> targets(edgeCount);
+	{
+		std::vector< std::atomic<uint64_t> > next(nodeCount);
+		parallelFor(threadCount, [&](uint32_t thread) {
+			for(uint64_t i(edgeCount*thread/threadCount), s(edgeCount*(thread+1)/threadCount); i < s; ++i) {
+				next[m_edges[i].source].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+		for(uint32_t v(0); v < nodeCount; ++v) {
+			offsets[v+1] = offsets[v] + next[v].exchange(offsets[v], std::memory_order_relaxed);
+		}
+		parallelFor(threadCount, [&](uint32_t thread) {
+			for(uint64_t i(edgeCount*thread/threadCount), s(edgeCount*(thread+1)/threadCount); i < s; ++i) {
+				targets[next[m_edges[i].source].fetch_add(1, std::memory_order_relaxed)] = m_edges[i].target;
+			}
+		});
+	}
+	//Tarjan's algorithm with an explicit call stack.
+	//A node is on the Tarjan stack iff it is visited but has no label yet
+	std::vector<uint32_t> index(nodeCount, Unvisited);
+	std::vector<uint32_t> lowLink(nodeCount);
+	std::vector<uint32_t> stack;
+	std::vector< std::pair<uint32_t, uint64_t> > callStack; //(node, position of its next edge)
+	std::fill(label.begin(), label.end(), Unvisited);
+	uint32_t nextIndex = 0;
+	uint32_t sccCount = 0;
+	auto visit = [&](uint32_t v) {
+		index[v] = lowLink[v] = nextIndex++;
+		stack.push_back(v);
+		callStack.emplace_back(v, offsets[v]);
+	};
+	for(uint32_t root(0); root < nodeCount; ++root) {
+		if (index[root] != Unvisited) {
+			continue;
+		}
+		visit(root);
+		while (callStack.size()) {
+			uint32_t v = callStack.back().first;
+			uint64_t & pos = callStack.back().second;
+			if (pos < offsets[v+1]) {
+				uint32_t w = targets[pos++];
+				if (index[w] == Unvisited) {
+					visit(w);
+				}
+				else if (label[w] == Unvisited) {
+					lowLink[v] = std::min(lowLink[v], index[w]);
+				}
+				continue;
+			}
+			if (lowLink[v] == index[v]) {
+				uint32_t w;
+				do {
+					w = stack.back();
+					stack.pop_back();
+					label[w] = sccCount;
+				} while (w != v);
+				++sccCount;
+			}
+			callStack.pop_back();
+			if (callStack.size()) {
+				uint32_t u = callStack.back().first;
+				lowLink[u] = std::min(lowLink[u], lowLink[v]);
+			}
+		}
+	}
+}
+
 void
 CCGraphWriter::endGraph() {
 	if (m_nodes.size() > std::numeric_limits<uint32_t>::max()) {
@@ -365,119 +783,130 @@ CCGraphWriter::endGraph() {
 	if (m_edges.size() > std::numeric_limits<uint32_t>::max()) {
 		throw std::runtime_error("Too many edges to compute connected components and the header count is wrong");
 	}
-	std::cout << "Finding connected components for " << m_nodes.size() << " nodes and " << m_edges.size() << " edges" << std::endl;
-	using UnionFind = sserialize::UnionFind<uint32_t>;
-	using UFHandle = UnionFind::handle_type;
-	UnionFind uf;
-	std::vector<UFHandle> ufh(m_nodes.size());
-	//add all nodes as single sets
-	std::cout << "Creating single sets for union find" << std::endl;
-	for(std::size_t i(0), s(m_nodes.size()); i < s; ++i) {
-		ufh.at(i) = uf.make_set(i);
-	}
-	std::cout << "Uniting all nodes using edges" << std::endl;
-	//now unite all nodes that have an edge between each other
-	for(auto const & e : m_edges) {
-		uf.unite(ufh.at(e.source), ufh.at(e.target));
-	}
-	//Get all unique representatives
-	std::cout << "Setting node representatives" << std::endl;
-	std::unordered_map<UFHandle, std::pair<uint64_t, uint64_t>> cch; //first entry is node count second the edge count
-	for(std::size_t i(0), s(m_nodes.size()); i < s; ++i) {
-		cch[uf.find(ufh.at(i))] = std::pair<uint64_t, uint64_t>(0,0);
-	}
-	std::cout << "Found " << cch.size() << " connected components" << std::endl;
-	//Now we have a Problem: For planet there will be thousands of connected components
-	//However we cannot open thousands of files
-	//We can either create a mapping vector which we sort according to our representative
-	//Or we traverse all nodes/edges per connected component
-	//Quick calc: About 10^9 Nodes and 2*10^9 edges sort takes -> log(10^9) ~ log(2^30) ~30 longer than a single pass
-	//Thus sorting should be way faster
-	//sort all nodes according to their representative
-	auto sortByRep = [&](auto && a, auto && b) -> bool {
-		auto repa = uf.find(ufh.at(a));
-		auto repb = uf.find(ufh.at(b));
-		return repa == repb ? a < b : repa < repb;
-	};
-	
-	std::cout << "Sorting " << m_nodes.size() << " nodes according to their connected component" << std::endl;
-	std::vector<uint32_t> nodesSortedByRep(m_nodes.size());
-	for(std::size_t i(0); i < m_nodes.size(); ++i) {
-		auto nodeRep = uf.find(ufh.at(i));
-		cch.at(nodeRep).first += 1;
-		nodesSortedByRep.at(i) = i;
-	}
-	std::sort(nodesSortedByRep.begin(), nodesSortedByRep.end(), sortByRep);
-	
-	//do the same for the edges
-	//By definition the rep of source and target are the same
-	std::cout << "Sorting " << m_edges.size() << " edges according to their connected component" << std::endl;
-	std::vector<uint32_t> edgesSortedByRep(m_edges.size());
-	for(std::size_t i(0), s(m_edges.size()); i < s; ++i) {
-		cch.at(uf.find(ufh.at(m_edges.at(i).source))).second += 1;
-		edgesSortedByRep.at(i) = i;
-	}
-	{ //do consistency check
-		std::size_t nn{0}, ne{0};
-		for(auto const & x : cch) {
-			nn += x.second.first;
-			ne += x.second.second;
+	const uint32_t nodeCount = m_nodes.size();
+	const uint32_t edgeCount = m_edges.size();
+	const uint32_t threadCount = m_threadCount;
+	//[chunkBegin(size, thread), chunkBegin(size, thread+1)) is the part of thread
+	auto chunkBegin = [threadCount](uint64_t size, uint32_t thread) -> uint64_t { return size*thread/threadCount; };
+	for(const Edge & e : m_edges) {
+		if (e.source >= nodeCount || e.target >= nodeCount) {
+			throw std::runtime_error("CCGraphWriter: edge references an unknown node");
 		}
-		if (nn != m_nodes.size()) {
-			throw std::runtime_error("Summed node count of connected components does not match total node count");
+	}
+	std::cout << "Finding " << (m_strongComponents ? "strongly " : "") << "connected components for " << nodeCount << " nodes and " << edgeCount << " edges" << std::endl;
+	std::vector<uint32_t> label(nodeCount); //connected component of each node
+	if (m_strongComponents) {
+		strongComponents(label);
+	}
+	else {
+		weakComponents(label);
+	}
+	//Number the components by their smallest node
+	uint32_t ccCount = 0;
+	{
+		std::vector<uint32_t> ccNumber(nodeCount, std::numeric_limits<uint32_t>::max());
+		for(uint32_t i(0); i < nodeCount; ++i) {
+			if (ccNumber[label[i]] == std::numeric_limits<uint32_t>::max()) {
+				ccNumber[label[i]] = ccCount++;
+			}
+			label[i] = ccNumber[label[i]];
 		}
-		if (ne != m_edges.size()) {
-			throw std::runtime_error("Summed edge count of connected components does not match total edge count");
+	}
+	std::cout << "Found " << ccCount << " connected components" << std::endl;
+	//edges between strongly connected components do not belong to any component
+	auto inComponent = [&label](const Edge & e) { return label[e.source] == label[e.target]; };
+	
+	//Bucket the nodes by their component with a counting sort.
+	//Nodes of a component keep their order which gives their local ids.
+	std::vector<uint64_t> ccNodeBegin(ccCount+1, 0);
+	for(uint32_t i(0); i < nodeCount; ++i) {
+		ccNodeBegin[label[i]+1] += 1;
+	}
+	for(uint32_t cc(0); cc < ccCount; ++cc) {
+		ccNodeBegin[cc+1] += ccNodeBegin[cc];
+	}
+	std::vector<uint32_t> nodesByCC(nodeCount);
+	std::vector<uint32_t> localNodeId(nodeCount);
+	{
+		std::vector<uint64_t> next(ccNodeBegin.begin(), ccNodeBegin.end()-1);
+		for(uint32_t i(0); i < nodeCount; ++i) {
+			uint64_t pos = next[label[i]]++;
+			nodesByCC[pos] = i;
+			localNodeId[i] = pos - ccNodeBegin[label[i]];
 		}
 	}
-	std::sort(edgesSortedByRep.begin(), edgesSortedByRep.end(),
-				[&](auto && a, auto && b) -> bool {
-					Edge const & ea = m_edges.at(a);
-					Edge const & eb = m_edges.at(b);
-					auto rep_srca = uf.find(ufh.at(ea.source));
-					auto rep_srcb = uf.find(ufh.at(eb.source));
-					if (rep_srca == rep_srcb) {
-						//nodes are within the same cc,
-						//we then sort them by their source and the by target
-						//as the SortedEdgeWriter would do
-						//This works since nodes within a cc are sorted by their id/position (which should be the same)
-						return (ea.source == eb.source ? ea.target < eb.target : ea.source < eb.source);
-					}
-					else {
-						return rep_srca < rep_srcb;
-					}
+	
+	//Bucket the edges by their source in the order of nodesByCC.
+	//This groups them by component and sorts them by source like the SortedEdgeWriter.
+	std::cout << "Sorting " << edgeCount << " edges according to their connected component" << std::endl;
+	std::vector<uint32_t> edgesByCC;
+	std::vector<uint64_t> edgeBegin(uint64_t(nodeCount)+1, 0); //first edge of the node at nodesByCC[i]
+	std::vector<uint64_t> ccEdgeBegin(ccCount+1, 0);
+	{
+		std::vector< std::atomic<uint64_t> > next(nodeCount);
+		parallelFor(threadCount, [&](uint32_t thread) {
+			for(uint64_t i(chunkBegin(edgeCount, thread)), s(chunkBegin(edgeCount, thread+1)); i < s; ++i) {
+				if (inComponent(m_edges[i])) {
+					next[m_edges[i].source].fetch_add(1, std::memory_order_relaxed);
 				}
-	);
-	// contains the representatives of all CC that are written to disk
-	std::unordered_map<UFHandle, CCId> write_filter;
+			}
+		});
+		uint64_t offset = 0;
+		for(uint32_t cc(0); cc < ccCount; ++cc) {
+			ccEdgeBegin[cc] = offset;
+			for(uint64_t pos(ccNodeBegin[cc]), s(ccNodeBegin[cc+1]); pos < s; ++pos) {
+				edgeBegin[pos] = offset;
+				offset += next[nodesByCC[pos]].exchange(offset, std::memory_order_relaxed);
+			}
+		}
+		ccEdgeBegin[ccCount] = offset;
+		edgeBegin[nodeCount] = offset;
+		edgesByCC.resize(offset);
+		parallelFor(threadCount, [&](uint32_t thread) {
+			for(uint64_t i(chunkBegin(edgeCount, thread)), s(chunkBegin(edgeCount, thread+1)); i < s; ++i) {
+				if (inComponent(m_edges[i])) {
+					edgesByCC[next[m_edges[i].source].fetch_add(1, std::memory_order_relaxed)] = i;
+				}
+			}
+		});
+	}
+	//Edges of a node are placed in arbitrary order, sort them by target and then by their position
+	//which gives the same order as a stable sort
+	parallelFor(threadCount, [&](uint32_t thread) {
+		for(uint64_t pos(chunkBegin(nodeCount, thread)), s(chunkBegin(nodeCount, thread+1)); pos < s; ++pos) {
+			std::sort(edgesByCC.begin()+edgeBegin[pos], edgesByCC.begin()+edgeBegin[pos+1], [this](uint32_t a, uint32_t b) {
+				uint32_t ta = m_edges[a].target;
+				uint32_t tb = m_edges[b].target;
+				return ta == tb ? a < b : ta < tb;
+			});
+		}
+	});
+	auto ccNodeCount = [&](uint32_t cc) -> uint64_t { return ccNodeBegin[cc+1] - ccNodeBegin[cc]; };
+	auto ccEdgeCount = [&](uint32_t cc) -> uint64_t { return ccEdgeBegin[cc+1] - ccEdgeBegin[cc]; };
+	
+	// the components that are written to disk ordered by their CCId
+	std::vector<uint32_t> selected;
 	{
-		std::vector<UFHandle> cch_by_size;
-		cch_by_size.reserve(cch.size());
-		for(auto const & x : cch) {
-			cch_by_size.emplace_back(x.first);
+		//sort components by size, descending
+		std::vector<uint32_t> cch_by_size(ccCount);
+		for(uint32_t cc(0); cc < ccCount; ++cc) {
+			cch_by_size[cc] = cc;
 		}
-		std::sort(cch_by_size.begin(), cch_by_size.end(), [&](auto a, auto b) -> bool {
-			auto const & a_s = cch.at(a);
-			auto const & b_s = cch.at(b);
-			
-			if (a_s.first == b_s.first) {
-				if (a_s.second == b_s.second) {
+		std::sort(cch_by_size.begin(), cch_by_size.end(), [&](uint32_t a, uint32_t b) -> bool {
+			if (ccNodeCount(a) == ccNodeCount(b)) {
+				if (ccEdgeCount(a) == ccEdgeCount(b)) {
 					return a < b; //this is necessary since we need a strict weak order on cch_by_size
 				}
-				return a_s.second < b_s.second;
+				return ccEdgeCount(a) > ccEdgeCount(b);
 			}
-			return a_s.first < b_s.first;
+			return ccNodeCount(a) > ccNodeCount(b);
 		});
-		std::reverse(cch_by_size.begin(), cch_by_size.end());
-		//cch_by_size is sorted by size, ascending
-		CCId ccid = 0;
 		switch(m_filter_mode) {
 			case FilterMode::MinSize:
 			{
-				for(auto const & rep : cch_by_size) {
-					if (cch.at(rep).first >= m_filter_value) {
-						write_filter[rep] = ccid;
-						++ccid;
+				for(uint32_t cc : cch_by_size) {
+					if (ccNodeCount(cc) >= m_filter_value) {
+						selected.push_back(cc);
 					}
 					else {
 						break;
@@ -487,12 +916,14 @@ CCGraphWriter::endGraph() {
 			}
 			case FilterMode::TopK:
 			{
-				auto last_size = cch.at(cch_by_size.front());
-				for(auto rep : cch_by_size) {
-					if (auto current_size = cch.at(rep); write_filter.size() < m_filter_value || current_size == last_size) {
+				if (cch_by_size.empty()) {
+					break;
+				}
+				auto last_size = std::make_pair(ccNodeCount(cch_by_size.front()), ccEdgeCount(cch_by_size.front()));
+				for(uint32_t cc : cch_by_size) {
+					if (auto current_size = std::make_pair(ccNodeCount(cc), ccEdgeCount(cc)); selected.size() < m_filter_value || current_size == last_size) {
 						last_size = current_size;
-						write_filter[rep] = ccid;
-						++ccid;
+						selected.push_back(cc);
 					}
 					else {
 						break;
@@ -502,66 +933,99 @@ CCGraphWriter::endGraph() {
 			}
 			case FilterMode::All:
 			{
-				for(auto rep : cch_by_size) {
-					write_filter[rep] = ccid;
-					++ccid;
-				}
+				selected = std::move(cch_by_size);
 				break;
 			}
 		}
 	}
-	std::cout << "Found " << write_filter.size() << " connected components above your threshold" << std::endl;
-	
+	std::cout << "Found " << selected.size() << " connected components above your threshold" << std::endl;
 
-	//now write them out
-	std::size_t nodePos{0};
-	std::size_t edgePos{0};
-	std::vector<uint32_t> nodeIdRemap(m_nodes.size()); //remaps nodeIds to cc local ids
+	//now write them out, every thread writes whole components
+	uint64_t totalCount = 0;
+	for(uint32_t cc : selected) {
+		totalCount += ccNodeCount(cc) + ccEdgeCount(cc);
+	}
+	std::atomic<std::size_t> nextCC{0};
+	std::mutex mtx; //protects m_f, pinfo, writtenCount and error
+	uint64_t writtenCount = 0;
+	std::exception_ptr error;
 	sserialize::ProgressInfo pinfo;
-	pinfo.begin(m_nodes.size()+m_edges.size(), "Writing connected components");
-	for(std::size_t i(0), s(cch.size()); i < s; ++i) {
-		UFHandle ccrep = uf.find( ufh.at(nodesSortedByRep.at(nodePos)) );
-		auto const & nodeEdgeCount = cch.at(ccrep);
-		
-		if (!write_filter.count(ccrep)) {
-			nodePos += nodeEdgeCount.first;
-			edgePos += nodeEdgeCount.second;
-			continue;
-		}
-		auto ccId = write_filter.at(ccrep);
-		
-		auto writer = m_f(ccId);
-		writer->beginGraph();
-		writer->beginHeader();
-		writer->writeHeader(nodeEdgeCount.first, nodeEdgeCount.second);
-		writer->endHeader();
-		//now write all nodes and build mapping table on the fly
-		writer->beginNodes();
-		for(std::size_t cclNodeId(0); cclNodeId < nodeEdgeCount.first; ++cclNodeId, ++nodePos) {
-			uint32_t globalNodeId = nodesSortedByRep.at(nodePos);
-			assert(uf.find( ufh.at(globalNodeId) ) == ccrep);
-			//we need to remap the id of the node first
-			Node node = m_nodes.at(globalNodeId).first;
-			node.id = cclNodeId;
-			writer->writeNode(node, m_nodes.at(globalNodeId).second);
-			nodeIdRemap.at(globalNodeId) = cclNodeId;
-		}
-		writer->endNodes();
-		//And write all Edges but remap source/target to the new ids
-		writer->beginEdges();
-		for(std::size_t cclEdgeId(0); cclEdgeId < nodeEdgeCount.second; ++cclEdgeId, ++edgePos) {
-			assert(uf.find( ufh.at( m_edges.at(edgesSortedByRep.at(edgePos)).source) ) == ccrep);
-			Edge e = m_edges.at(edgesSortedByRep.at(edgePos));
-			e.source = nodeIdRemap.at(e.source);
-			e.target = nodeIdRemap.at(e.target);
-			writer->writeEdge(e);
+	pinfo.begin(totalCount, "Writing connected components");
+	parallelFor(std::min<std::size_t>(threadCount, std::max<std::size_t>(selected.size(), 1)), [&](uint32_t /*thread*/) {
+		//nodes and edges are passed to the writers in batches
+		std::vector<Node> batchNodes;
+		std::vector<Coordinates> batchCoordinates;
+		std::vector<Edge> batchEdges;
+		batchNodes.reserve(BatchSize);
+		batchCoordinates.reserve(BatchSize);
+		batchEdges.reserve(BatchSize);
+		for(std::size_t i = nextCC++; i < selected.size(); i = nextCC++) {
+			uint32_t cc = selected[i];
+			CCId ccId = i;
+			try {
+				std::shared_ptr<GraphWriter> writer;
+				{
+					std::lock_guard<std::mutex> lck(mtx);
+					if (error) {
+						return;
+					}
+					writer = m_f(ccId, ccNodeCount(cc), ccEdgeCount(cc));
+				}
+				writer->beginGraph();
+				writer->beginHeader();
+				writer->writeHeader(ccNodeCount(cc), ccEdgeCount(cc));
+				writer->endHeader();
+				writer->beginNodes();
+				for(uint64_t pos(ccNodeBegin[cc]), s(ccNodeBegin[cc+1]); pos < s; ++pos) {
+					uint32_t globalNodeId = nodesByCC[pos];
+					batchNodes.push_back(m_nodes[globalNodeId].first);
+					batchNodes.back().id = localNodeId[globalNodeId];
+					batchCoordinates.push_back(m_nodes[globalNodeId].second);
+					if (batchNodes.size() == BatchSize) {
+						writer->writeNodes(batchNodes.data(), batchCoordinates.data(), batchNodes.size());
+						batchNodes.clear();
+						batchCoordinates.clear();
+					}
+				}
+				writer->writeNodes(batchNodes.data(), batchCoordinates.data(), batchNodes.size());
+				batchNodes.clear();
+				batchCoordinates.clear();
+				writer->endNodes();
+				//And write all Edges but remap source/target to the local ids
+				writer->beginEdges();
+				for(uint64_t pos(ccEdgeBegin[cc]), s(ccEdgeBegin[cc+1]); pos < s; ++pos) {
+					batchEdges.push_back(m_edges[edgesByCC[pos]]);
+					Edge & e = batchEdges.back();
+					assert(label[e.source] == cc && label[e.target] == cc);
+					e.source = localNodeId[e.source];
+					e.target = localNodeId[e.target];
+					if (batchEdges.size() == BatchSize) {
+						writer->writeEdges(batchEdges.data(), batchEdges.size());
+						batchEdges.clear();
+					}
+				}
+				writer->writeEdges(batchEdges.data(), batchEdges.size());
+				batchEdges.clear();
+				writer->endEdges();
+				writer->endGraph();
+				writer.reset();
+				std::lock_guard<std::mutex> lck(mtx);
+				writtenCount += ccNodeCount(cc) + ccEdgeCount(cc);
+				pinfo(writtenCount, "ccid " + std::to_string(ccId) + ": #nodes=" + std::to_string(ccNodeCount(cc)) + " #edges=" + std::to_string(ccEdgeCount(cc)));
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lck(mtx);
+				if (!error) {
+					error = std::current_exception();
+				}
+				return;
+			}
 		}
-		writer->endEdges();
-		writer->endGraph();
-		++ccId;
-		pinfo(nodePos+edgePos, "ccid " + std::to_string(ccId) + ": #nodes=" + std::to_string(nodeEdgeCount.first) + " #edges=" + std::to_string(nodeEdgeCount.second));
-	}
+	});
 	pinfo.end();
+	if (error) {
+		std::rethrow_exception(error);
+	}
 }
 
 void
@@ -586,16 +1050,83 @@ CCGraphWriter::writeEdge(const graphtools::creator::Edge & edge) {
 	m_edges.emplace_back(edge);
 }
 
-PlotGraph::PlotGraph(std::shared_ptr<std::ostream> out) : m_out(out) {}
+void
+CCGraphWriter::writeEdges(const graphtools::creator::Edge * edges, std::size_t count) {
+	m_edges.insert(m_edges.end(), edges, edges+count);
+}
+
+PlotGraph::PlotGraph(std::shared_ptr<std::ostream> out, int coordinatePrecision) : m_buffer(out, coordinatePrecision) {}
 PlotGraph::~PlotGraph() {}
+void PlotGraph::endGraph() {
+	m_buffer.flush();
+}
 void PlotGraph::writeHeader(uint64_t nodeCount, uint64_t /*edgeCount*/) {
 	m_nodes.reserve(nodeCount);
 }
 void PlotGraph::writeNode(const osm::graphtools::creator::Node & /*node*/, const osm::graphtools::creator::Coordinates & coordinates) {
 	m_nodes.emplace_back(coordinates);
 }
+void PlotGraph::writeNodes(const osm::graphtools::creator::Node * /*nodes*/, const osm::graphtools::creator::Coordinates * coordinates, std::size_t count) {
+	m_nodes.insert(m_nodes.end(), coordinates, coordinates+count);
+}
 void PlotGraph::writeEdge(const graphtools::creator::Edge & edge) {
-	out() <<  m_nodes[edge.source].lon << " " << m_nodes[edge.source].lat << " " << m_nodes[edge.target].lon << " " << m_nodes[edge.target].lat << std::endl;
+	m_buffer.putText(m_nodes[edge.source].lon);
+	m_buffer.put(' ');
+	m_buffer.putText(m_nodes[edge.source].lat);
+	m_buffer.put(' ');
+	m_buffer.putText(m_nodes[edge.target].lon);
+	m_buffer.put(' ');
+	m_buffer.putText(m_nodes[edge.target].lat);
+	m_buffer.put('\n');
+}
+
+//BEGIN ShapeFileWriter
+ShapeFileWriter::ShapeFileWriter(std::shared_ptr<std::ostream> out) :
+m_buffer(out)
+{
+	m_buffer.put("OGCSHAP1", 8);
+}
+
+ShapeFileWriter::~ShapeFileWriter() {}
+
+void ShapeFileWriter::setChainEdges(std::vector<uint64_t> && chainEdges) {
+	m_chainEdges = std::move(chainEdges);
+	m_edgeCounts.assign(m_chainEdges.size(), 0);
+}
+
+uint32_t ShapeFileWriter::countEdge(uint32_t source, uint32_t target) {
+	uint64_t key = (uint64_t(source) << 32) | target;
+	auto it = std::lower_bound(m_chainEdges.begin(), m_chainEdges.end(), key);
+	if (it == m_chainEdges.end() || *it != key) {
+		return NoEdge;
+	}
+	return m_edgeCounts[it - m_chainEdges.begin()]++;
+}
+
+void ShapeFileWriter::writeShape(uint32_t source, uint32_t target, uint32_t rank, uint32_t reverseRank, const Coordinates & sourceCoordinates, const Coordinates * points, std::size_t count) {
+	if (rank == NoEdge) {
+		throw std::runtime_error("ShapeFileWriter: edge is not a chain edge");
+	}
+	m_record.clear();
+	putVarUInt(m_record, source);
+	putVarUInt(m_record, target);
+	putVarUInt(m_record, rank);
+	putVarUInt(m_record, reverseRank == NoEdge ? 0 : uint64_t(reverseRank)+1);
+	putVarUInt(m_record, count);
+	FixedPointCoordinates prev(sourceCoordinates);
+	for(std::size_t i(0); i < count; ++i) {
+		FixedPointCoordinates p(points[i]);
+		putVarSInt(m_record, int64_t(p.lat) - prev.lat);
+		putVarSInt(m_record, int64_t(p.lon) - prev.lon);
+		prev = p;
+	}
+	m_buffer.put(reinterpret_cast<const char*>(m_record.data()), m_record.size());
+}
+
+void ShapeFileWriter::flush() {
+	m_buffer.flush();
+	m_buffer.stream().flush();
 }
+//END ShapeFileWriter
 
 }}}//end namespace
@@ -2,15 +2,92 @@
 #define OSM_GRAPH_TOOLS_GRAPH_WRITER_H
 #include "types.h"
 #include "RamGraph.h"
+#include "EdgeSorter.h"
 #include <sserialize/stats/ProgressInfo.h>
 #include <sserialize/Static/DynamicFixedLengthVector.h>
 #include <ostream>
 #include <algorithm>
+#include <charconv>
+#include <limits>
+#include <cstring>
+#include <memory>
+#include <type_traits>
 
 namespace osm {
 namespace graphtools {
 namespace creator {
 
+///Collects the output of a writer in a large aligned buffer which is passed to the stream with a single write when it is full.
+///The buffer is flushed on destruction, call flush() before writing to the stream directly.
+///Numbers are formatted with std::to_chars independent of the locale and the format flags of the stream.
+class OutputBuffer {
+public:
+	static constexpr std::size_t DefaultCapacity = std::size_t(1) << 20;
+	static constexpr std::size_t Alignment = 4096;
+	///write doubles with the least number of decimal digits that reads back to the same value
+	static constexpr int ShortestPrecision = -1;
+	///number of decimal digits of doubles, this is the same as std::fixed with std::setprecision(digits10+2)
+	static constexpr int DefaultPrecision = std::numeric_limits<double>::digits10 + 2;
+public:
+	///@param precision number of decimal digits of doubles in fixed notation or ShortestPrecision
+	OutputBuffer(std::shared_ptr<std::ostream> out, int precision = DefaultPrecision, std::size_t capacity = DefaultCapacity);
+	OutputBuffer(const OutputBuffer & other) = delete;
+	OutputBuffer & operator=(const OutputBuffer & other) = delete;
+	~OutputBuffer();
+	inline std::ostream & stream() { return *m_out; }
+	///passes the buffered data to the stream
+	void flush();
+	///makes sure that size bytes fit into the buffer, size has to be at most the capacity
+	inline void reserve(std::size_t size) {
+		assert(size <= m_capacity);
+		if (m_size + size > m_capacity) {
+			flush();
+		}
+	}
+	inline void put(const char * data, std::size_t size) {
+		if (size > m_capacity) {
+			flush();
+			m_out->write(data, size);
+			return;
+		}
+		reserve(size);
+		::memcpy(m_data.get()+m_size, data, size);
+		m_size += size;
+	}
+	inline void put(char c) {
+		reserve(1);
+		m_data.get()[m_size++] = c;
+	}
+	///puts the bytes of v
+	template<typename T>
+	inline void putRaw(T v) {
+		static_assert(std::is_trivially_copyable<T>::value, "OutputBuffer::putRaw needs a trivially copyable type");
+		reserve(sizeof(T));
+		::memcpy(m_data.get()+m_size, &v, sizeof(T));
+		m_size += sizeof(T);
+	}
+	///puts v as text, this is the same as std::ostream::operator<<
+	template<typename T>
+	inline typename std::enable_if<std::is_integral<T>::value>::type putText(T v) {
+		reserve(MaxTextSize);
+		char * begin = m_data.get()+m_size;
+		m_size += std::to_chars(begin, begin+MaxTextSize, v).ptr - begin;
+	}
+	///puts v as text in fixed notation with the precision given on construction
+	void putText(double v);
+private:
+	struct Deleter {
+		void operator()(char * p) const { ::operator delete[](p, std::align_val_t(Alignment)); }
+	};
+	static constexpr std::size_t MaxTextSize = 32;
+private:
+	std::shared_ptr<std::ostream> m_out;
+	std::unique_ptr<char[], Deleter> m_data;
+	std::size_t m_capacity;
+	std::size_t m_size{0};
+	int m_precision;
+};
+
 struct GraphWriter {
 	virtual ~GraphWriter() {}
 	
@@ -26,26 +103,24 @@ struct GraphWriter {
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount) = 0;
 	virtual void writeNode(const Node & node, const Coordinates & coordinates) = 0;
 	virtual void writeEdge(const Edge & edge) = 0;
-	template<typename TIterator>
-	void writeNodes(TIterator begin, TIterator end) {
-		sserialize::ProgressInfo progress;
-		progress.begin(end-begin, "Writing out nodes");
-		for(TIterator it(begin); it != end; ++it) {
-			writeNode(*it);
-			progress(it-begin);
+	///Writes count nodes with their coordinates, prefer this over writeNode.
+	///The default implementation calls writeNode for every node
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+		for(std::size_t i(0); i < count; ++i) {
+			writeNode(nodes[i], coordinates[i]);
 		}
-		progress.end();
 	}
-	template<typename TIterator>
-	void writeEdges(TIterator begin, TIterator end) {
-		sserialize::ProgressInfo progress;
-		progress.begin(end-begin, "Writing out edges");
-		for(TIterator it(begin); it != end; ++it) {
-			writeEdge(*it);
-			progress(it-begin);
+	///Writes count edges, prefer this over writeEdge.
+	///The default implementation calls writeEdge for every edge
+	virtual void writeEdges(const Edge * edges, std::size_t count) {
+		for(std::size_t i(0); i < count; ++i) {
+			writeEdge(edges[i]);
 		}
-		progress.end();
 	}
+#ifdef CONFIG_CREATOR_FIXED_POINT_COORDINATES
+	///Converts the coordinates in chunks and writes them with writeNodes
+	void writeNodes(const Node * nodes, const StoredCoordinates * coordinates, std::size_t count);
+#endif
 };
 
 class DropGraphWriter: public GraphWriter {
@@ -65,15 +140,19 @@ private:
 
 class TopologyTextGraphWriter: public GraphWriter {
 private:
-	std::shared_ptr<std::ostream> m_out;
+	OutputBuffer m_buffer;
 protected:
-	inline std::ostream & out() { return *m_out; }
+	inline std::ostream & out() { m_buffer.flush(); return m_buffer.stream(); }
+	inline OutputBuffer & buffer() { return m_buffer; }
 public:
-	TopologyTextGraphWriter(std::shared_ptr<std::ostream> out);
+	TopologyTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision = OutputBuffer::DefaultPrecision);
 	virtual ~TopologyTextGraphWriter();
+	virtual void endGraph();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
 	virtual void writeNode(const Node & node, const Coordinates & coordinates);
 	virtual void writeEdge(const Edge & edge);
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count);
+	virtual void writeEdges(const Edge * edges, std::size_t count);
 };
 
 /**
@@ -88,70 +167,92 @@ public:
  */
 class TopologyBinaryGraphWriter: public GraphWriter {
 private:
-	std::shared_ptr<std::ostream> m_out;
+	OutputBuffer m_buffer;
 protected:
-	inline std::ostream & out() { return *m_out; }
+	inline std::ostream & out() { m_buffer.flush(); return m_buffer.stream(); }
 	void putUnsignedLong(uint64_t v);
 	void putDouble(double v);
 public:
 	TopologyBinaryGraphWriter(std::shared_ptr<std::ostream> out);
 	virtual ~TopologyBinaryGraphWriter();
+	virtual void endGraph();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
 	virtual void writeNode(const Node & node, const Coordinates & coordinates);
 	virtual void writeEdge(const Edge & edge);
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count);
+	virtual void writeEdges(const Edge * edges, std::size_t count);
 };
 
 class FmiTextGraphWriter: public GraphWriter {
 private:
-	std::shared_ptr<std::ostream> m_out;
+	OutputBuffer m_buffer;
 protected:
-	inline std::ostream & out() { return *m_out; }
+	inline std::ostream & out() { m_buffer.flush(); return m_buffer.stream(); }
+	inline OutputBuffer & buffer() { return m_buffer; }
+	void putNode(const Node & node, const Coordinates & coordinates);
+	virtual void putEdge(const Edge & edge);
 public:
-	FmiTextGraphWriter(std::shared_ptr<std::ostream> out);
+	FmiTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision = OutputBuffer::DefaultPrecision);
 	virtual ~FmiTextGraphWriter();
+	virtual void endGraph();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
 	virtual void writeNode(const Node & node, const Coordinates & coordinates);
 	virtual void writeEdge(const Edge & edge);
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count);
+	virtual void writeEdges(const Edge * edges, std::size_t count);
 };
 
 class FmiMaxSpeedTextGraphWriter: public FmiTextGraphWriter {
+protected:
+	virtual void putEdge(const Edge & edge);
 public:
-	FmiMaxSpeedTextGraphWriter(std::shared_ptr<std::ostream> out);
+	FmiMaxSpeedTextGraphWriter(std::shared_ptr<std::ostream> out, int coordinatePrecision = OutputBuffer::DefaultPrecision);
 	virtual ~FmiMaxSpeedTextGraphWriter();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
-	virtual void writeEdge(const Edge & edge);
 };
 
 class FmiBinaryGraphWriter: public GraphWriter {
 private:
-	std::shared_ptr<std::ostream> m_out;
+	OutputBuffer m_buffer;
 protected:
-	inline std::ostream & out() { return *m_out; }
+	inline std::ostream & out() { m_buffer.flush(); return m_buffer.stream(); }
+	void putNode(const Node & node, const Coordinates & coordinates);
+	virtual void putEdge(const Edge & edge);
 public:
 	FmiBinaryGraphWriter(std::shared_ptr<std::ostream> out);
 	virtual ~FmiBinaryGraphWriter();
 	void putInt(int32_t v);
 	void putLong(int64_t v);
 	void putDouble(double v);
+	void putString(const std::string & v);
+	virtual void endGraph();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
 	virtual void writeNode(const Node & node, const Coordinates & coordinates);
 	virtual void writeEdge(const Edge & edge);
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count);
+	virtual void writeEdges(const Edge * edges, std::size_t count);
 };
 
 class FmiMaxSpeedBinaryGraphWriter: public FmiBinaryGraphWriter {
+protected:
+	virtual void putEdge(const Edge & edge);
 public:
 	FmiMaxSpeedBinaryGraphWriter(std::shared_ptr<std::ostream> out);
 	virtual ~FmiMaxSpeedBinaryGraphWriter();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
-	virtual void writeEdge(const Edge & edge);
 };
 
+///Sorts edges by source and target before passing them to the base writer, see EdgeSorter
 class SortedEdgeWriter: public GraphWriter {
 private:
 	std::shared_ptr<GraphWriter> m_baseGraphWriter;
-	std::vector<Edge> m_edges;
+	EdgeSorter m_sorter;
 public:
-	SortedEdgeWriter(std::shared_ptr<GraphWriter> & baseGraphWriter) : m_baseGraphWriter(baseGraphWriter) {}
+	///@param memoryBudget in bytes, edges are sorted externally in tempDirectory if they need more memory
+	SortedEdgeWriter(std::shared_ptr<GraphWriter> & baseGraphWriter, uint32_t threadCount, uint64_t memoryBudget, const std::string & tempDirectory) :
+	m_baseGraphWriter(baseGraphWriter),
+	m_sorter(threadCount, memoryBudget, tempDirectory)
+	{}
 	virtual ~SortedEdgeWriter() {}
 	virtual void beginGraph() {m_baseGraphWriter->beginGraph();}
 	virtual void beginHeader() {m_baseGraphWriter->beginHeader();}
@@ -160,24 +261,77 @@ public:
 	virtual void endNodes() {m_baseGraphWriter->endNodes();}
 	virtual void beginEdges() {}
 	virtual void endEdges() {
-		std::sort(m_edges.begin(), m_edges.end(), [](const Edge & e1, const Edge & e2) {
-			return (e1.source == e2.source ? e1.target < e2.target : e1.source < e2.source);
-		});
 		m_baseGraphWriter->beginEdges();
-		for(const Edge & e : m_edges) {
-			m_baseGraphWriter->writeEdge(e);
-		}
+		m_sorter.finish([this](const Edge * edges, std::size_t count) {
+			m_baseGraphWriter->writeEdges(edges, count);
+		});
 		m_baseGraphWriter->endEdges();
-		m_edges = std::vector<Edge>();
 	}
 	virtual void endGraph() {m_baseGraphWriter->endGraph();}
 
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount) {
-		m_edges.reserve(edgeCount);
+		m_sorter.reserve(edgeCount);
 		m_baseGraphWriter->writeHeader(nodeCount, edgeCount);
 	}
 	virtual void writeNode(const Node & node, const Coordinates & coordinates) { m_baseGraphWriter->writeNode(node, coordinates); };
-	virtual void writeEdge(const Edge & edge) { m_edges.push_back(edge); }
+	virtual void writeEdge(const Edge & edge) { m_sorter.add(edge); }
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+		m_baseGraphWriter->writeNodes(nodes, coordinates, count);
+	}
+	virtual void writeEdges(const Edge * edges, std::size_t count) { m_sorter.add(edges, count); }
+};
+
+/**
+ * Groups edges by their source like SortedEdgeWriter, but places every edge directly at its position.
+ * The positions are given by the out-degrees of the nodes which have to be set by setEdgeOffsets() before the first edge.
+ * Edges are stored in a memory mapped temporary file in tempDirectory which is removed by the system when the writer is destroyed.
+ * If sortTargets is set, edges with the same source are sorted by target which gives the same order as SortedEdgeWriter,
+ * otherwise they keep the order in which they were written.
+ */
+class PlacedEdgeWriter: public GraphWriter {
+public:
+	PlacedEdgeWriter(std::shared_ptr<GraphWriter> & baseGraphWriter, bool sortTargets, const std::string & tempDirectory);
+	virtual ~PlacedEdgeWriter();
+	///@param offsets offsets[i] is the position of the first edge with source i, offsets.back() is the number of edges
+	void setEdgeOffsets(std::vector<uint64_t> && offsets);
+	virtual void beginGraph() {m_baseGraphWriter->beginGraph();}
+	virtual void beginHeader() {m_baseGraphWriter->beginHeader();}
+	virtual void endHeader() {m_baseGraphWriter->endHeader();}
+	virtual void beginNodes() {m_baseGraphWriter->beginNodes();}
+	virtual void endNodes() {m_baseGraphWriter->endNodes();}
+	virtual void beginEdges() {}
+	virtual void endEdges();
+	virtual void endGraph() {m_baseGraphWriter->endGraph();}
+
+	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount) { m_baseGraphWriter->writeHeader(nodeCount, edgeCount); }
+	virtual void writeNode(const Node & node, const Coordinates & coordinates) { m_baseGraphWriter->writeNode(node, coordinates); };
+	virtual void writeEdge(const Edge & edge);
+	virtual void writeNodes(const Node * nodes, const Coordinates * coordinates, std::size_t count) {
+		m_baseGraphWriter->writeNodes(nodes, coordinates, count);
+	}
+	virtual void writeEdges(const Edge * edges, std::size_t count);
+private:
+	///an edge without its source which is given by its position
+	struct PlacedEdge {
+		uint32_t target;
+		int32_t weight;
+		int32_t type;
+		int32_t maxspeed;
+	};
+private:
+	void unmap();
+private:
+	std::shared_ptr<GraphWriter> m_baseGraphWriter;
+	bool m_sortTargets;
+	std::string m_tempDirectory;
+	std::vector<uint64_t> m_offsets;
+	std::vector<uint64_t> m_next; ///position of the next edge of every node
+	PlacedEdge * m_edges{0};
+	uint64_t m_edgeCount{0};
+	int m_fd{-1};
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	std::vector<std::string> m_tags;
+	#endif
 };
 
 #ifdef CONFIG_SUPPORT_SSERIALIZE_OFFSET_ARRAY_TARGET
@@ -213,39 +367,87 @@ public:
 
 #endif
 
-///Writes each connected component into an extra file
+///Writes each connected component into an extra file.
+///Components are labelled by a concurrent union find and written by threadCount threads at the same time.
+///With strongComponents the components are the strongly connected components of the directed graph,
+///which are found by Tarjan's algorithm. Edges between them are dropped.
 class CCGraphWriter: public GraphWriter {
 public:
 	using CCId = uint32_t;
-	///A factory that creates a new graph writer for the given connected component id
-	using GraphWriterFactory = std::function<std::shared_ptr<GraphWriter>(CCId)>;
+	///A factory that creates a new graph writer for the given connected component id and its node and edge count.
+	///Calls are serialized, but the returned writers are used concurrently
+	using GraphWriterFactory = std::function<std::shared_ptr<GraphWriter>(CCId, uint64_t nodeCount, uint64_t edgeCount)>;
 public:
-	CCGraphWriter(GraphWriterFactory factory, FilterMode filter_mode, std::size_t filter_value);
+	CCGraphWriter(GraphWriterFactory factory, FilterMode filter_mode, std::size_t filter_value, uint32_t threadCount = 1, bool strongComponents = false);
 	~CCGraphWriter() override;
 	void endGraph() override;
 	void writeHeader(uint64_t nodeCount, uint64_t edgeCount) override;
 	void writeNode(const graphtools::creator::Node & node, const Coordinates & coordinates) override;
 	void writeEdge(const graphtools::creator::Edge & edge) override;
+	void writeEdges(const graphtools::creator::Edge * edges, std::size_t count) override;
+private:
+	///number of nodes or edges passed to the writers of the components at once
+	static constexpr std::size_t BatchSize = 4096;
+private:
+	///sets label[i] to an id of the component of node i, nodes with the same id are in the same component
+	void weakComponents(std::vector<uint32_t> & label) const;
+	void strongComponents(std::vector<uint32_t> & label) const;
 private:
 	std::vector< std::pair<Node, Coordinates> > m_nodes;
 	std::vector<Edge> m_edges;
 	GraphWriterFactory m_f;
 	FilterMode m_filter_mode;
 	std::size_t m_filter_value;
+	uint32_t m_threadCount;
+	bool m_strongComponents;
 };
 
 class PlotGraph: public graphtools::creator::GraphWriter {
 private:
-	std::shared_ptr<std::ostream> m_out;
+	OutputBuffer m_buffer;
 	std::vector<Coordinates> m_nodes;
-protected:
-	inline std::ostream & out() { return *m_out; }
 public:
-	PlotGraph(std::shared_ptr<std::ostream> out);
+	PlotGraph(std::shared_ptr<std::ostream> out, int coordinatePrecision = OutputBuffer::DefaultPrecision);
 	virtual ~PlotGraph();
+	virtual void endGraph();
 	virtual void writeHeader(uint64_t nodeCount, uint64_t edgeCount);
 	virtual void writeNode(const graphtools::creator::Node & node, const Coordinates & coordinates);
 	virtual void writeEdge(const graphtools::creator::Edge & edge);
+	virtual void writeNodes(const graphtools::creator::Node * nodes, const Coordinates * coordinates, std::size_t count);
+};
+
+/**
+ * Writes the geometry of the edges of contracted chains, see --contract-chains.
+ * Format: "OGCSHAP1" followed by a record for every edge with inner points:
+ * SOURCE TARGET RANK REVERSERANK COUNT (DLAT DLON)*COUNT
+ * All numbers are LEB128 varints. DLAT and DLON are zigzag encoded differences in 1e-7 degrees to the previous point,
+ * the first point is relative to the source node.
+ * RANK is the number of edges from SOURCE to TARGET before the edge in the graph. This identifies the edge since
+ * edges with the same source and target keep the order in which they are written for all graph types and with -s.
+ * REVERSERANK is 0 if the edge has no reverse edge, otherwise the rank of the reverse edge plus 1.
+ * The reverse edge has the same points in reverse order and no record of its own.
+ */
+class ShapeFileWriter {
+public:
+	static constexpr uint32_t NoEdge = std::numeric_limits<uint32_t>::max();
+public:
+	ShapeFileWriter(std::shared_ptr<std::ostream> out);
+	~ShapeFileWriter();
+	///@param chainEdges (source << 32 | target) of every edge with inner points and of its reverse edge, sorted and unique
+	void setChainEdges(std::vector<uint64_t> && chainEdges);
+	///Counts an edge of the graph, has to be called for every written edge in the order they are written.
+	///@return the rank of the edge if there is a chain edge from source to target, NoEdge otherwise
+	uint32_t countEdge(uint32_t source, uint32_t target);
+	///@param points the inner points of the edge from source to target
+	///@param rank of the edge, see countEdge()
+	///@param reverseRank of the reverse edge or NoEdge
+	void writeShape(uint32_t source, uint32_t target, uint32_t rank, uint32_t reverseRank, const Coordinates & sourceCoordinates, const Coordinates * points, std::size_t count);
+	void flush();
+private:
+	OutputBuffer m_buffer;
+	std::vector<uint8_t> m_record;
+	std::vector<uint64_t> m_chainEdges;
+	std::vector<uint32_t> m_edgeCounts; ///number of edges counted for every entry of m_chainEdges
 };
 
 }}}//end namespace
@@ -0,0 +1,169 @@
+#include "GzipOutputStream.h"
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+GzipOutputStreamBuffer::GzipOutputStreamBuffer(std::shared_ptr<std::ostream> target, uint32_t threadCount, int level, std::size_t blockSize) :
+m_target(target),
+m_level(level),
+m_blockSize(std::max<std::size_t>(blockSize, 1)),
+m_maxPending(2*std::max<uint32_t>(threadCount, 1)),
+m_current(m_blockSize)
+{
+	setp(m_current.data(), m_current.data() + m_blockSize);
+	for(uint32_t i(0), s(std::max<uint32_t>(threadCount, 1)); i < s; ++i) {
+		m_threads.emplace_back([this]() { run(); });
+	}
+}
+
+GzipOutputStreamBuffer::~GzipOutputStreamBuffer() {
+	//an empty stream still gets a gzip member to be a valid gzip file
+	submit(0, true);
+	m_target->flush();
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		m_stop = true;
+	}
+	m_workCv.notify_all();
+	for(std::thread & t : m_threads) {
+		t.join();
+	}
+}
+
+bool GzipOutputStreamBuffer::submit(std::size_t maxPending, bool force) {
+	std::unique_lock<std::mutex> lck(m_mtx);
+	if (pptr() != pbase() || (force && m_empty)) {
+		std::unique_ptr<Block> block;
+		if (m_freeBlocks.size()) {
+			block = std::move(m_freeBlocks.back());
+			m_freeBlocks.pop_back();
+		}
+		else {
+			block.reset(new Block());
+		}
+		block->data.swap(m_current);
+		block->data.resize(pptr() - pbase());
+		block->compressing = false;
+		block->done = false;
+		m_pending.push_back(std::move(block));
+		m_empty = false;
+		m_workCv.notify_one();
+		m_current.resize(m_blockSize);
+		setp(m_current.data(), m_current.data() + m_blockSize);
+	}
+	//write finished blocks in order, wait for the oldest block if too many are pending
+	while (m_pending.size() && (m_pending.size() > maxPending || m_pending.front()->done)) {
+		m_doneCv.wait(lck, [this]() { return m_pending.front()->done; });
+		std::unique_ptr<Block> block = std::move(m_pending.front());
+		m_pending.pop_front();
+		lck.unlock();
+		m_target->write(block->compressed.data(), block->compressed.size());
+		bool ok = bool(*m_target);
+		lck.lock();
+		m_failed = m_failed || !ok;
+		m_freeBlocks.push_back(std::move(block));
+	}
+	return !m_failed;
+}
+
+void GzipOutputStreamBuffer::run() {
+	z_stream stream;
+	::memset(&stream, 0, sizeof(stream));
+	//window bits of 15+16 write a gzip header and trailer
+	bool initialized = (::deflateInit2(&stream, m_level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+	std::unique_lock<std::mutex> lck(m_mtx);
+	while (true) {
+		Block * block = 0;
+		m_workCv.wait(lck, [this, &block]() {
+			for(const std::unique_ptr<Block> & x : m_pending) {
+				if (!x->compressing) {
+					block = x.get();
+					return true;
+				}
+			}
+			return m_stop;
+		});
+		if (!block) {
+			break;
+		}
+		block->compressing = true;
+		lck.unlock();
+		bool ok = initialized && compress(&stream, *block);
+		lck.lock();
+		block->done = true;
+		m_failed = m_failed || !ok;
+		m_doneCv.notify_all();
+	}
+	if (initialized) {
+		::deflateEnd(&stream);
+	}
+}
+
+bool GzipOutputStreamBuffer::compress(void * zstream, Block & block) {
+	z_stream & stream = *static_cast<z_stream*>(zstream);
+	if (::deflateReset(&stream) != Z_OK) {
+		return false;
+	}
+	block.compressed.resize(::deflateBound(&stream, block.data.size()));
+	stream.next_in = reinterpret_cast<Bytef*>(block.data.data());
+	stream.avail_in = block.data.size();
+	stream.next_out = reinterpret_cast<Bytef*>(block.compressed.data());
+	stream.avail_out = block.compressed.size();
+	if (::deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+		return false;
+	}
+	block.compressed.resize(stream.total_out);
+	return true;
+}
+
+GzipOutputStreamBuffer::int_type GzipOutputStreamBuffer::overflow(int_type ch) {
+	if (!submit(m_maxPending)) {
+		return traits_type::eof();
+	}
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize GzipOutputStreamBuffer::xsputn(const char * s, std::streamsize n) {
+	std::streamsize written = 0;
+	while (written < n) {
+		std::streamsize available = epptr() - pptr();
+		if (!available) {
+			if (!submit(m_maxPending)) {
+				break;
+			}
+			continue;
+		}
+		std::streamsize len = std::min(available, n - written);
+		::memcpy(pptr(), s + written, len);
+		pbump(int(len));
+		written += len;
+	}
+	return written;
+}
+
+int GzipOutputStreamBuffer::sync() {
+	bool ok = submit(0);
+	m_target->flush();
+	return (ok && *m_target) ? 0 : -1;
+}
+
+GzipOutputStream::GzipOutputStream(std::shared_ptr<std::ostream> target, uint32_t threadCount, int level, std::size_t blockSize) :
+std::ostream(nullptr),
+m_buffer(target, threadCount, level, blockSize)
+{
+	rdbuf(&m_buffer);
+}
+
+GzipOutputStream::~GzipOutputStream() {
+	flush();
+}
+
+}}}//end namespace
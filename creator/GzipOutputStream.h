@@ -0,0 +1,76 @@
+#ifndef OSM_GRAPH_TOOLS_GZIP_OUTPUT_STREAM_H
+#define OSM_GRAPH_TOOLS_GZIP_OUTPUT_STREAM_H
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * A stream buffer that compresses its data with gzip using multiple threads.
+ * The data is split into blocks of blockSize bytes which are compressed independently into separate gzip members.
+ * The concatenation of gzip members is a valid gzip file which gzip, zcat and zlib's gzread decompress as a whole.
+ * Compressed blocks are written to the target in order by the thread writing to this stream buffer.
+ *
+ * Errors of zlib or of the target are reported by the next call of sync() or when a block is submitted.
+ */
+class GzipOutputStreamBuffer: public std::streambuf {
+public:
+	static constexpr std::size_t DefaultBlockSize = std::size_t(1) << 20;
+public:
+	///@param level zlib compression level, -1 selects the default level of zlib
+	GzipOutputStreamBuffer(std::shared_ptr<std::ostream> target, uint32_t threadCount, int level = -1, std::size_t blockSize = DefaultBlockSize);
+	~GzipOutputStreamBuffer() override;
+protected:
+	int_type overflow(int_type ch) override;
+	std::streamsize xsputn(const char * s, std::streamsize n) override;
+	int sync() override;
+private:
+	struct Block {
+		std::vector<char> data;
+		std::vector<char> compressed;
+		bool compressing{false};
+		bool done{false};
+	};
+private:
+	///Queues the current block for compression and writes finished blocks until at most maxPending blocks are queued.
+	///With force an empty block is queued if nothing was written yet
+	bool submit(std::size_t maxPending, bool force = false);
+	void run();
+	static bool compress(void * stream, Block & block);
+private:
+	std::shared_ptr<std::ostream> m_target;
+	int m_level;
+	std::size_t m_blockSize;
+	std::size_t m_maxPending;
+	std::vector<char> m_current;
+	std::mutex m_mtx;
+	std::condition_variable m_workCv;
+	std::condition_variable m_doneCv;
+	std::deque<std::unique_ptr<Block>> m_pending;
+	std::vector<std::unique_ptr<Block>> m_freeBlocks;
+	bool m_stop{false};
+	bool m_failed{false};
+	bool m_empty{true};
+	std::vector<std::thread> m_threads;
+};
+
+///An output stream using a GzipOutputStreamBuffer
+class GzipOutputStream: public std::ostream {
+public:
+	GzipOutputStream(std::shared_ptr<std::ostream> target, uint32_t threadCount, int level = -1, std::size_t blockSize = GzipOutputStreamBuffer::DefaultBlockSize);
+	~GzipOutputStream() override;
+private:
+	GzipOutputStreamBuffer m_buffer;
+};
+
+}}}//end namespace
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef OSM_GRAPH_TOOLS_NODE_ID_MAP_H
+#define OSM_GRAPH_TOOLS_NODE_ID_MAP_H
+#include <stdint.h>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include <sserialize/containers/DirectHugeHash.h>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * A bit vector with a rank directory.
+ * Setting and testing bits is thread-safe, i.e. a single thread may set bits while others test them.
+ * The rank directory stores the number of set bits before every block of 8 words,
+ * hence it needs 1/8 bit per bit and rank() needs at most 8 popcounts.
+ */
+class RankBitVector {
+public:
+	RankBitVector() {}
+	RankBitVector(uint64_t size) : m_size(size), m_d((size+63)/64, 0) {}
+	inline uint64_t size() const { return m_size; }
+	inline bool test(uint64_t pos) const {
+		assert(pos < m_size);
+		return (__atomic_load_n(&m_d[pos/64], __ATOMIC_RELAXED) >> (pos%64)) & 1;
+	}
+	///@return true if the bit was not set before
+	inline bool set(uint64_t pos) {
+		assert(pos < m_size && !m_rankValid);
+		uint64_t mask = uint64_t(1) << (pos%64);
+		return !(__atomic_fetch_or(&m_d[pos/64], mask, __ATOMIC_RELAXED) & mask);
+	}
+	///number of set bits
+	uint64_t count() const {
+		if (m_rankValid) {
+			return m_count;
+		}
+		uint64_t result = 0;
+		for(uint64_t w : m_d) {
+			result += __builtin_popcountll(w);
+		}
+		return result;
+	}
+	///Builds the rank directory. The bit vector may not be changed afterwards
+	void buildRank() {
+		m_blockRank.resize(m_d.size()/WordsPerBlock+1);
+		uint64_t rank = 0;
+		for(std::size_t i(0), s(m_d.size()); i < s; ++i) {
+			if (i % WordsPerBlock == 0) {
+				m_blockRank[i/WordsPerBlock] = rank;
+			}
+			rank += __builtin_popcountll(m_d[i]);
+		}
+		m_count = rank;
+		m_rankValid = true;
+	}
+	///@return the number of set bits before pos
+	inline uint64_t rank(uint64_t pos) const {
+		assert(m_rankValid && pos < m_size);
+		uint64_t word = pos/64;
+		uint64_t result = m_blockRank[word/WordsPerBlock];
+		for(uint64_t i(word - word%WordsPerBlock); i < word; ++i) {
+			result += __builtin_popcountll(m_d[i]);
+		}
+		return result + __builtin_popcountll(m_d[word] & ((uint64_t(1) << (pos%64))-1));
+	}
+	///memory usage in bytes
+	inline uint64_t memoryUsage() const { return (m_d.size() + m_blockRank.size())*sizeof(uint64_t); }
+	static inline uint64_t memoryUsage(uint64_t size) { return ((size+63)/64)*sizeof(uint64_t)*(WordsPerBlock+1)/WordsPerBlock; }
+private:
+	static constexpr uint64_t WordsPerBlock = 8;
+	uint64_t m_size{0};
+	std::vector<uint64_t> m_d;
+	std::vector<uint64_t> m_blockRank;
+	uint64_t m_count{0};
+	bool m_rankValid{false};
+};
+
+/**
+ * Maps osm node ids to our node ids.
+ * Until node ids are assigned the map stores the status of a node, see NodeCandidate etc.
+ *
+ * There are two backends:
+ * NM_HASH uses a sserialize::DirectHugeHashMap and stores a 32 bit value for every node.
+ * NM_RANK stores a bit per status for every osm id in [begin, end].
+ * With NM_RANK node ids can not be set explicitly. Instead assignIdsByRank() assigns every node with a given status
+ * the number of such nodes with a smaller osm id. This needs about 1.1 bit per osm id in the range.
+ */
+class NodeIdMap {
+public:
+	enum Backend {NM_HASH, NM_RANK};
+	static constexpr uint32_t NodeCandidate = std::numeric_limits<uint32_t>::max(); ///referenced by some way
+	static constexpr uint32_t NodeAvailable = std::numeric_limits<uint32_t>::max()-1; ///referenced and present in the input
+	static constexpr uint32_t NodeNeeded = std::numeric_limits<uint32_t>::max()-2; ///referenced by a valid way
+public:
+	///Map using a sserialize::DirectHugeHashMap without a direct mapped range
+	NodeIdMap() {}
+	///Map for the osm ids in [begin, end]. With NM_HASH osm ids outside of the range are stored in a hash map.
+	NodeIdMap(int64_t begin, int64_t end, Backend backend) :
+	m_backend(backend),
+	m_begin(begin)
+	{
+		if (backend == NM_HASH) {
+			m_hash = HashMap(begin, end, sserialize::MM_SHARED_MEMORY);
+		}
+		else {
+			m_candidate = RankBitVector(end-begin+1);
+			m_available = RankBitVector(end-begin+1);
+			m_needed = RankBitVector(end-begin+1);
+		}
+	}
+	inline Backend backend() const { return m_backend; }
+	///node ids are given by the rank of the osm id
+	inline bool idsByRank() const { return m_backend == NM_RANK; }
+	///number of nodes in the map
+	inline uint64_t size() const {
+		return m_backend == NM_HASH ? m_hash.size() : m_candidate.count();
+	}
+	inline std::size_t count(int64_t osmId) const {
+		if (m_backend == NM_HASH) {
+			return m_hash.count(osmId);
+		}
+		return inRange(osmId) && m_candidate.test(osmId - m_begin);
+	}
+	///@return the status or the node id of osmId
+	inline uint32_t at(int64_t osmId) const {
+		if (m_backend == NM_HASH) {
+			return m_hash.at(osmId);
+		}
+		if (!count(osmId)) {
+			throw std::out_of_range("NodeIdMap::at");
+		}
+		uint64_t pos = osmId - m_begin;
+		if (m_ranked) {
+			return m_candidate.rank(pos);
+		}
+		if (m_needed.test(pos)) {
+			return NodeNeeded;
+		}
+		return m_available.test(pos) ? NodeAvailable : NodeCandidate;
+	}
+	///Sets the status or the node id of osmId.
+	///With NM_RANK this can only set a status before assignIdsByRank was called.
+	///With NM_RANK setting a status is thread-safe with respect to concurrent calls of count() and at().
+	///With NM_HASH only count() of osm ids that are already in the map may be called concurrently
+	///since set() writes the value of the entry without synchronization
+	inline void set(int64_t osmId, uint32_t value) {
+		if (m_backend == NM_HASH) {
+			m_hash[osmId] = value;
+			return;
+		}
+		if (!inRange(osmId)) {
+			throw std::out_of_range("NodeIdMap::set: osm id is outside of the range of the map");
+		}
+		uint64_t pos = osmId - m_begin;
+		if (m_ranked) {
+			assert(m_candidate.rank(pos) == value);
+			return;
+		}
+		switch (value) {
+		case NodeCandidate:
+			m_candidate.set(pos);
+			break;
+		case NodeAvailable:
+			assert(m_candidate.test(pos));
+			m_available.set(pos);
+			break;
+		case NodeNeeded:
+			assert(m_candidate.test(pos));
+			m_needed.set(pos);
+			break;
+		default:
+			throw std::runtime_error("NodeIdMap::set: node ids can only be assigned by rank");
+		}
+	}
+	///Only valid for NM_RANK. Removes all nodes whose status is not status,
+	///the remaining nodes get the number of remaining nodes with smaller osm id as node id
+	///@return the number of nodes
+	uint64_t assignIdsByRank(uint32_t status) {
+		assert(m_backend == NM_RANK && !m_ranked);
+		if (status == NodeNeeded) {
+			m_candidate = std::move(m_needed);
+		}
+		else if (status == NodeAvailable) {
+			m_candidate = std::move(m_available);
+		}
+		m_available = RankBitVector();
+		m_needed = RankBitVector();
+		m_candidate.buildRank();
+		m_ranked = true;
+		return m_candidate.count();
+	}
+	///memory needed by NM_RANK for a range of size osm ids
+	static inline uint64_t rankMemoryUsage(uint64_t size) { return 3*RankBitVector::memoryUsage(size); }
+private:
+	typedef sserialize::DirectHugeHashMap<uint32_t> HashMap;
+private:
+	inline bool inRange(int64_t osmId) const { return osmId >= m_begin && uint64_t(osmId - m_begin) < m_candidate.size(); }
+private:
+	Backend m_backend{NM_HASH};
+	HashMap m_hash;
+	int64_t m_begin{0};
+	RankBitVector m_candidate; ///after assignIdsByRank these are the nodes with ids
+	RankBitVector m_available;
+	RankBitVector m_needed;
+	bool m_ranked{false};
+};
+
+}}}//end namespace
+
+#endif
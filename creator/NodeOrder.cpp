@@ -0,0 +1,104 @@
+#include "NodeOrder.h"
+#include "Parallel.h"
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+namespace {
+
+///below this number of nodes a thread is not worth it
+constexpr std::size_t MinChunkSize = 1 << 16;
+
+struct NodeKey {
+	uint64_t key;
+	uint32_t node;
+};
+
+///spreads the bits of x to the even bits of the result
+inline uint64_t spreadBits(uint32_t x) {
+	uint64_t v = x;
+	v = (v | (v << 16)) & 0x0000FFFF0000FFFFULL;
+	v = (v | (v << 8)) & 0x00FF00FF00FF00FFULL;
+	v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	v = (v | (v << 2)) & 0x3333333333333333ULL;
+	v = (v | (v << 1)) & 0x5555555555555555ULL;
+	return v;
+}
+
+} //end namespace
+
+uint64_t hilbertKey(uint32_t x, uint32_t y) {
+	uint64_t d = 0;
+	for(uint32_t s(uint32_t(1) << 31); s; s >>= 1) {
+		uint32_t rx = (x & s) ? 1 : 0;
+		uint32_t ry = (y & s) ? 1 : 0;
+		d += uint64_t(s) * s * ((3 * rx) ^ ry);
+		//rotate the quadrant such that the curve continues, only the bits below s are used afterwards
+		if (!ry) {
+			if (rx) {
+				x = ~x;
+				y = ~y;
+			}
+			std::swap(x, y);
+		}
+	}
+	return d;
+}
+
+uint64_t mortonKey(uint32_t x, uint32_t y) {
+	return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+std::vector<uint32_t> spatialNodeOrder(const StoredCoordinates * coordinates, std::size_t count, NodeOrder order, uint32_t threadCount) {
+	threadCount = std::max<uint32_t>(1, std::min<uint64_t>(threadCount, count/MinChunkSize));
+	auto chunkBegin = [count, threadCount](uint32_t thread) { return count*thread/threadCount; };
+
+	//bounding box of the nodes
+	std::vector<double> bounds(4*threadCount);
+	parallelFor(threadCount, [&](uint32_t thread) {
+		double * b = bounds.data() + 4*thread;
+		b[0] = b[2] = std::numeric_limits<double>::max();
+		b[1] = b[3] = std::numeric_limits<double>::lowest();
+		for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+			Coordinates c(coordinates[i]);
+			b[0] = std::min(b[0], c.lat);
+			b[1] = std::max(b[1], c.lat);
+			b[2] = std::min(b[2], c.lon);
+			b[3] = std::max(b[3], c.lon);
+		}
+	});
+	for(uint32_t thread(1); thread < threadCount; ++thread) {
+		bounds[0] = std::min(bounds[0], bounds[4*thread]);
+		bounds[1] = std::max(bounds[1], bounds[4*thread+1]);
+		bounds[2] = std::min(bounds[2], bounds[4*thread+2]);
+		bounds[3] = std::max(bounds[3], bounds[4*thread+3]);
+	}
+	constexpr double GridSize = double(std::numeric_limits<uint32_t>::max());
+	double latScale = bounds[1] > bounds[0] ? GridSize/(bounds[1]-bounds[0]) : 0;
+	double lonScale = bounds[3] > bounds[2] ? GridSize/(bounds[3]-bounds[2]) : 0;
+
+	std::vector<NodeKey> keys(count);
+	parallelFor(threadCount, [&](uint32_t thread) {
+		for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+			Coordinates c(coordinates[i]);
+			uint32_t x = std::min(GridSize, (c.lon-bounds[2])*lonScale);
+			uint32_t y = std::min(GridSize, (c.lat-bounds[0])*latScale);
+			keys[i].key = order == NO_HILBERT ? hilbertKey(x, y) : mortonKey(x, y);
+			keys[i].node = i;
+		}
+	});
+	std::vector<NodeKey> buffer;
+	radixSort(keys, buffer, threadCount, [](const NodeKey & k) { return k.key; }, MinChunkSize);
+	buffer = std::vector<NodeKey>();
+
+	std::vector<uint32_t> nodeIds(count);
+	parallelFor(threadCount, [&](uint32_t thread) {
+		for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+			nodeIds[keys[i].node] = i;
+		}
+	});
+	return nodeIds;
+}
+
+}}}//end namespace
@@ -0,0 +1,24 @@
+#ifndef OSM_GRAPH_TOOLS_NODE_ORDER_H
+#define OSM_GRAPH_TOOLS_NODE_ORDER_H
+#include "types.h"
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+///Position of (x, y) on the Hilbert curve through the 2^32 x 2^32 grid
+uint64_t hilbertKey(uint32_t x, uint32_t y);
+///Position of (x, y) on the Z-order curve through the 2^32 x 2^32 grid, i.e. the bits of x and y interleaved
+uint64_t mortonKey(uint32_t x, uint32_t y);
+
+/**
+ * Orders nodes along a space filling curve through the bounding box of the nodes.
+ * Nodes with the same key keep their relative order.
+ * The keys are computed and sorted by a parallel radix sort using threadCount threads.
+ * @return the new id of every node
+ */
+std::vector<uint32_t> spatialNodeOrder(const StoredCoordinates * coordinates, std::size_t count, NodeOrder order, uint32_t threadCount);
+
+}}}//end namespace
+
+#endif
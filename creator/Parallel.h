@@ -0,0 +1,90 @@
+#ifndef OSM_GRAPH_TOOLS_PARALLEL_H
+#define OSM_GRAPH_TOOLS_PARALLEL_H
+#include <stdint.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+///Calls f(threadId) for every thread id in [0, threadCount), f(0) is called by the calling thread.
+///f must not throw
+template<typename TFunc>
+void parallelFor(uint32_t threadCount, TFunc f) {
+	std::vector<std::thread> threads;
+	for(uint32_t i(1); i < threadCount; ++i) {
+		threads.emplace_back(f, i);
+	}
+	f(0);
+	for(std::thread & t : threads) {
+		t.join();
+	}
+}
+
+///Stable LSD radix sort of items by the uint64_t key(item) using buffer as temporary storage.
+///Every pass counts the digits of a chunk of items per thread and then moves the items of each chunk to their bucket.
+///Every thread gets at least minChunkSize items
+template<typename T, typename TKey>
+void radixSort(std::vector<T> & items, std::vector<T> & buffer, uint32_t threadCount, TKey key, std::size_t minChunkSize) {
+	constexpr uint32_t DigitBits = 11;
+	constexpr uint64_t BucketCount = uint64_t(1) << DigitBits;
+	const std::size_t n = items.size();
+	threadCount = std::max<uint32_t>(1, std::min<uint64_t>(threadCount, n/std::max<std::size_t>(minChunkSize, 1)));
+	auto chunkBegin = [n, threadCount](uint32_t thread) { return n*thread/threadCount; };
+
+	//only digits up to the highest set bit of a key need to be sorted
+	std::vector<uint64_t> keyBits(threadCount, 0);
+	parallelFor(threadCount, [&](uint32_t thread) {
+		uint64_t bits = 0;
+		for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+			bits |= key(items[i]);
+		}
+		keyBits[thread] = bits;
+	});
+	uint64_t bits = 0;
+	for(uint64_t x : keyBits) {
+		bits |= x;
+	}
+	uint32_t significantBits = 64 - (bits ? __builtin_clzll(bits) : 64);
+
+	buffer.resize(n);
+	std::vector<uint64_t> offsets(threadCount*BucketCount);
+	for(uint32_t shift(0); shift < significantBits; shift += DigitBits) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+		parallelFor(threadCount, [&](uint32_t thread) {
+			uint64_t * counts = offsets.data() + thread*BucketCount;
+			for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+				counts[(key(items[i]) >> shift) & (BucketCount-1)] += 1;
+			}
+		});
+		//offsets of the chunks within their buckets, buckets are ordered by digit and then by thread
+		uint64_t offset = 0;
+		bool trivial = false;
+		for(uint64_t digit(0); digit < BucketCount; ++digit) {
+			uint64_t bucketBegin = offset;
+			for(uint32_t thread(0); thread < threadCount; ++thread) {
+				uint64_t count = offsets[thread*BucketCount + digit];
+				offsets[thread*BucketCount + digit] = offset;
+				offset += count;
+			}
+			trivial = trivial || offset - bucketBegin == n;
+		}
+		//all items have the same digit
+		if (trivial) {
+			continue;
+		}
+		parallelFor(threadCount, [&](uint32_t thread) {
+			uint64_t * bucketOffsets = offsets.data() + thread*BucketCount;
+			for(std::size_t i(chunkBegin(thread)), s(chunkBegin(thread+1)); i < s; ++i) {
+				buffer[bucketOffsets[(key(items[i]) >> shift) & (BucketCount-1)]++] = std::move(items[i]);
+			}
+		});
+		items.swap(buffer);
+	}
+}
+
+}}}//end namespace
+
+#endif
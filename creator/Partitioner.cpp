@@ -0,0 +1,365 @@
+#include "Partitioner.h"
+#include "Encoding.h"
+#include "Parallel.h"
+#include <condition_variable>
+#include <mutex>
+#include <numeric>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+namespace {
+
+///the first and the last BalanceFraction of the projected nodes are the sources and sinks of the flow
+constexpr double BalanceFraction = 0.25;
+constexpr uint32_t NoNode = std::numeric_limits<uint32_t>::max();
+
+enum Terminal : uint8_t {T_NONE, T_SOURCE, T_SINK};
+
+} //end namespace
+
+constexpr char Partitioner::Magic[9];
+
+///Undirected graph given by adjacency arrays, every edge is an arc in both directions.
+///Nodes are numbered locally, nodes[i] is the id of node i in the whole graph
+struct Partitioner::SubGraph {
+	uint32_t treeNode{0};
+	std::vector<uint32_t> nodes;
+	std::vector<uint64_t> offsets; ///the arcs of node i are [offsets[i], offsets[i+1])
+	std::vector<uint32_t> targets;
+	std::vector<uint64_t> reverse; ///the arc in the opposite direction
+	inline uint32_t size() const { return nodes.size(); }
+	///@param edges edges given by local node ids, loops are dropped
+	void build(const std::vector<NodePair> & edges) {
+		offsets.assign(nodes.size()+1, 0);
+		for(const NodePair & e : edges) {
+			if (e.first != e.second) {
+				offsets.at(e.first+1) += 1;
+				offsets.at(e.second+1) += 1;
+			}
+		}
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+		targets.resize(offsets.back());
+		reverse.resize(offsets.back());
+		std::vector<uint64_t> next(offsets.begin(), offsets.end()-1);
+		for(const NodePair & e : edges) {
+			if (e.first != e.second) {
+				uint64_t a = next[e.first]++;
+				uint64_t b = next[e.second]++;
+				targets[a] = e.second;
+				targets[b] = e.first;
+				reverse[a] = b;
+				reverse[b] = a;
+			}
+		}
+	}
+};
+
+///Node of the bisection tree, leaves are the cells
+struct Partitioner::BisectionNode {
+	uint32_t children[2] = {NoNode, NoNode};
+	std::vector<uint32_t> nodes; ///nodes of a cell
+};
+
+Partitioner::Partitioner(const StoredCoordinates * coordinates, uint32_t nodeCount, uint32_t threadCount) :
+m_coordinates(coordinates),
+m_nodeCount(nodeCount),
+m_threadCount(std::max<uint32_t>(threadCount, 1))
+{}
+
+void Partitioner::run(std::vector<NodePair> && edges, uint32_t maxCellSize) {
+	maxCellSize = std::max<uint32_t>(maxCellSize, 1);
+	std::vector<BisectionNode> bisectionNodes(1);
+	std::vector<SubGraph> pending(1);
+	pending.back().nodes.resize(m_nodeCount);
+	std::iota(pending.back().nodes.begin(), pending.back().nodes.end(), 0);
+	pending.back().build(edges);
+	edges = std::vector<NodePair>();
+
+	//Subgraphs are taken from the back of pending, which keeps the number of pending subgraphs small
+	std::mutex mtx;
+	std::condition_variable cv;
+	uint32_t busy = 0;
+	std::string error;
+	parallelFor(m_threadCount, [&](uint32_t) {
+		std::unique_lock<std::mutex> lck(mtx);
+		while (true) {
+			cv.wait(lck, [&]() { return pending.size() || !busy || error.size(); });
+			if (pending.empty() || error.size()) {
+				break;
+			}
+			SubGraph g = std::move(pending.back());
+			pending.pop_back();
+			++busy;
+			lck.unlock();
+			SubGraph children[2];
+			bool isCell = g.size() <= maxCellSize;
+			std::string e;
+			if (!isCell) {
+				try {
+					split(g, bisect(g), children[0], children[1]);
+				}
+				catch (const std::exception & ex) {
+					e = ex.what();
+				}
+			}
+			lck.lock();
+			--busy;
+			if (e.size()) {
+				error = e;
+			}
+			else if (isCell) {
+				bisectionNodes[g.treeNode].nodes = std::move(g.nodes);
+			}
+			else {
+				for(uint32_t i(0); i < 2; ++i) {
+					bisectionNodes[g.treeNode].children[i] = bisectionNodes.size();
+					children[i].treeNode = bisectionNodes.size();
+					bisectionNodes.emplace_back();
+					pending.push_back(std::move(children[i]));
+				}
+			}
+			cv.notify_all();
+		}
+		cv.notify_all();
+	});
+	if (error.size()) {
+		throw std::runtime_error("Partitioner: " + error);
+	}
+
+	m_cells.assign(m_nodeCount, 0);
+	m_tree.clear();
+	m_tree.reserve(bisectionNodes.size());
+	uint32_t nextCell = 0;
+	numberCells(bisectionNodes, 0, nextCell);
+}
+
+void Partitioner::numberCells(std::vector<BisectionNode> & nodes, uint32_t node, uint32_t & nextCell) {
+	std::size_t pos = m_tree.size();
+	m_tree.push_back(TreeNode{nextCell, 0});
+	if (nodes[node].children[0] == NoNode) {
+		for(uint32_t v : nodes[node].nodes) {
+			m_cells[v] = nextCell;
+		}
+		nodes[node].nodes = std::vector<uint32_t>();
+		++nextCell;
+	}
+	else {
+		numberCells(nodes, nodes[node].children[0], nextCell);
+		numberCells(nodes, nodes[node].children[1], nextCell);
+	}
+	m_tree[pos].cellCount = nextCell - m_tree[pos].firstCell;
+}
+
+std::vector<uint8_t> Partitioner::bisect(const SubGraph & g) const {
+	const uint32_t n = g.size();
+	const uint32_t terminalCount = std::max<uint32_t>(1, n*BalanceFraction);
+	//lines through the coordinates: longitude, latitude and both diagonals
+	const double directions[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+	std::vector<double> projection(n);
+	std::vector<uint32_t> order(n);
+	std::vector<uint8_t> terminal(n);
+	std::vector<int8_t> flow(g.targets.size());
+	std::vector<int32_t> level(n);
+	std::vector<uint8_t> reachesSink(n);
+	std::vector<uint64_t> current(n);
+	std::vector<uint32_t> queue;
+	std::vector<uint64_t> path;
+	queue.reserve(n);
+
+	std::vector<uint8_t> best;
+	uint64_t bestCut = std::numeric_limits<uint64_t>::max();
+	uint64_t bestImbalance = std::numeric_limits<uint64_t>::max();
+	for(const auto & direction : directions) {
+		for(uint32_t i(0); i < n; ++i) {
+			Coordinates c(m_coordinates[g.nodes[i]]);
+			projection[i] = direction[0]*c.lat + direction[1]*c.lon;
+		}
+		std::iota(order.begin(), order.end(), 0);
+		auto less = [&projection](uint32_t a, uint32_t b) { return projection[a] < projection[b]; };
+		std::nth_element(order.begin(), order.begin()+terminalCount, order.end(), less);
+		std::nth_element(order.begin()+terminalCount, order.end()-terminalCount, order.end(), less);
+		std::fill(terminal.begin(), terminal.end(), T_NONE);
+		for(uint32_t i(0); i < terminalCount; ++i) {
+			terminal[order[i]] = T_SOURCE;
+			terminal[order[n-1-i]] = T_SINK;
+		}
+
+		//Dinic's algorithm with all sources and all sinks merged into one node each.
+		//An arc has capacity 1 and carries flow[a] = -flow[reverse[a]] units, hence its residual capacity is 1-flow[a]
+		std::fill(flow.begin(), flow.end(), 0);
+		uint64_t cut = 0;
+		while (true) {
+			//levels of the nodes reachable from the sources, sinks are not expanded
+			std::fill(level.begin(), level.end(), -1);
+			queue.clear();
+			for(uint32_t v(0); v < n; ++v) {
+				if (terminal[v] == T_SOURCE) {
+					level[v] = 0;
+					queue.push_back(v);
+				}
+			}
+			bool sinkReached = false;
+			for(std::size_t i(0); i < queue.size(); ++i) {
+				uint32_t u = queue[i];
+				for(uint64_t a(g.offsets[u]), s(g.offsets[u+1]); a < s; ++a) {
+					uint32_t t = g.targets[a];
+					if (level[t] < 0 && flow[a] < 1) {
+						level[t] = level[u]+1;
+						if (terminal[t] == T_SINK) {
+							sinkReached = true;
+						}
+						else {
+							queue.push_back(t);
+						}
+					}
+				}
+			}
+			if (!sinkReached) {
+				break;
+			}
+			//blocking flow along arcs that increase the level, nodes without a path to a sink get level -1
+			for(uint32_t v(0); v < n; ++v) {
+				current[v] = g.offsets[v];
+			}
+			for(uint32_t source(0); source < n; ++source) {
+				if (terminal[source] != T_SOURCE) {
+					continue;
+				}
+				path.clear();
+				uint32_t u = source;
+				while (true) {
+					if (terminal[u] == T_SINK) {
+						for(uint64_t a : path) {
+							flow[a] += 1;
+							flow[g.reverse[a]] -= 1;
+						}
+						++cut;
+						path.clear();
+						u = source;
+						continue;
+					}
+					uint64_t & arc = current[u];
+					while (arc < g.offsets[u+1] && (flow[arc] == 1 || level[g.targets[arc]] != level[u]+1)) {
+						++arc;
+					}
+					if (arc < g.offsets[u+1]) {
+						path.push_back(arc);
+						u = g.targets[arc];
+						continue;
+					}
+					if (u == source) {
+						break;
+					}
+					//dead end, retreat to the previous node and skip the arc to u
+					level[u] = -1;
+					uint64_t back = path.back();
+					path.pop_back();
+					u = g.targets[g.reverse[back]];
+					++current[u];
+				}
+			}
+		}
+		//The nodes reached by the last search are the smallest source side of a minimum cut.
+		//The largest source side are the nodes that can not reach a sink in the residual graph
+		std::fill(reachesSink.begin(), reachesSink.end(), 0);
+		queue.clear();
+		for(uint32_t v(0); v < n; ++v) {
+			if (terminal[v] == T_SINK) {
+				reachesSink[v] = 1;
+				queue.push_back(v);
+			}
+		}
+		for(std::size_t i(0); i < queue.size(); ++i) {
+			uint32_t v = queue[i];
+			for(uint64_t a(g.offsets[v]), s(g.offsets[v+1]); a < s; ++a) {
+				uint32_t u = g.targets[a];
+				if (!reachesSink[u] && flow[g.reverse[a]] < 1) {
+					reachesSink[u] = 1;
+					queue.push_back(u);
+				}
+			}
+		}
+		uint64_t smallSide = 0;
+		uint64_t largeSide = n - queue.size();
+		for(uint32_t v(0); v < n; ++v) {
+			smallSide += level[v] >= 0;
+		}
+		auto imbalanceOf = [n](uint64_t side) { return side > n-side ? 2*side-n : n-2*side; };
+		bool large = imbalanceOf(largeSide) < imbalanceOf(smallSide);
+		uint64_t imbalance = imbalanceOf(large ? largeSide : smallSide);
+		if (cut < bestCut || (cut == bestCut && imbalance < bestImbalance)) {
+			bestCut = cut;
+			bestImbalance = imbalance;
+			best.resize(n);
+			for(uint32_t v(0); v < n; ++v) {
+				best[v] = large ? !reachesSink[v] : level[v] >= 0;
+			}
+		}
+	}
+	return best;
+}
+
+void Partitioner::split(const SubGraph & g, const std::vector<uint8_t> & side, SubGraph & first, SubGraph & second) {
+	SubGraph * parts[2] = {&second, &first};
+	std::vector<uint32_t> localId(g.size());
+	for(uint32_t v(0), s(g.size()); v < s; ++v) {
+		localId[v] = parts[side[v]]->nodes.size();
+		parts[side[v]]->nodes.push_back(g.nodes[v]);
+	}
+	std::vector<NodePair> edges[2];
+	for(uint32_t u(0), s(g.size()); u < s; ++u) {
+		for(uint64_t a(g.offsets[u]), as(g.offsets[u+1]); a < as; ++a) {
+			uint32_t v = g.targets[a];
+			//every edge is taken once by the arc with the smaller index
+			if (a < g.reverse[a] && side[u] == side[v]) {
+				edges[side[u]].emplace_back(localId[u], localId[v]);
+			}
+		}
+	}
+	for(uint32_t i(0); i < 2; ++i) {
+		parts[i]->build(edges[i]);
+	}
+}
+
+std::vector<uint32_t> Partitioner::nodeOrder() const {
+	std::vector<uint32_t> offsets(cellCount()+1, 0);
+	for(uint32_t cell : m_cells) {
+		offsets[cell+1] += 1;
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+	std::vector<uint32_t> nodeIds(m_cells.size());
+	for(uint32_t v(0), s(m_cells.size()); v < s; ++v) {
+		nodeIds[v] = offsets[m_cells[v]]++;
+	}
+	return nodeIds;
+}
+
+void Partitioner::renumber(const std::vector<uint32_t> & nodeIds) {
+	std::vector<uint32_t> cells(m_cells.size());
+	for(uint32_t v(0), s(m_cells.size()); v < s; ++v) {
+		cells.at(nodeIds.at(v)) = m_cells[v];
+	}
+	m_cells.swap(cells);
+}
+
+void Partitioner::write(std::ostream & out) const {
+	out.write(Magic, 8);
+	putBigEndian(out, m_cells.size(), 8);
+	putBigEndian(out, cellCount(), 8);
+	for(uint32_t cell : m_cells) {
+		putBigEndian(out, cell, 4);
+	}
+	for(const TreeNode & t : m_tree) {
+		putBigEndian(out, t.firstCell, 4);
+		putBigEndian(out, t.cellCount, 4);
+	}
+	out.flush();
+	if (!out) {
+		throw std::runtime_error("Partitioner: could not write the cells");
+	}
+}
+
+}}}//end namespace
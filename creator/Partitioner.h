@@ -0,0 +1,71 @@
+#ifndef OSM_GRAPH_TOOLS_PARTITIONER_H
+#define OSM_GRAPH_TOOLS_PARTITIONER_H
+#include "types.h"
+#include <ostream>
+#include <utility>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+/**
+ * Nested partition of a graph into cells of at most maxCellSize nodes by recursive inertial flow bisection.
+ *
+ * A bisection projects the nodes on a few lines through their coordinates. For every line the first and the last
+ * quarter of the nodes are the sources and sinks of a unit capacity maximum flow. The minimum cut of the line with the
+ * fewest cut edges splits the nodes, hence both sides have at least a quarter of the nodes. Of the minimum cuts closest
+ * to the sources and closest to the sinks the more balanced one is taken.
+ * Independent subgraphs are bisected concurrently by threadCount threads.
+ *
+ * Cells are numbered in the preorder of the bisection tree, hence the cells of every subtree are a range of cell ids.
+ *
+ * File format of write(), all numbers are big endian:
+ * ------------------------------------------------------------------------------------------
+ * "OGCCELL1"|NODECOUNT|CELLCOUNT|CELL*NODECOUNT|(FIRSTCELL|CELLCOUNT)*(2*CELLCOUNT-1)
+ * ------------------------------------------------------------------------------------------
+ * NODECOUNT and CELLCOUNT are uint64_t, all other numbers are uint32_t.
+ * CELL is the cell of a node. The bisection tree follows in preorder, every entry is the range of cells of a subtree.
+ */
+class Partitioner {
+public:
+	static constexpr char Magic[9] = "OGCCELL1";
+	typedef std::pair<uint32_t, uint32_t> NodePair;
+	struct TreeNode {
+		uint32_t firstCell;
+		uint32_t cellCount;
+	};
+public:
+	Partitioner(const StoredCoordinates * coordinates, uint32_t nodeCount, uint32_t threadCount);
+	///@param edges every edge of the graph, their direction is ignored
+	void run(std::vector<NodePair> && edges, uint32_t maxCellSize);
+	inline uint32_t cellCount() const { return m_tree.size()/2 + 1; }
+	///the cell of every node
+	inline const std::vector<uint32_t> & cells() const { return m_cells; }
+	///the bisection tree in preorder
+	inline const std::vector<TreeNode> & tree() const { return m_tree; }
+	///@return the new id of every node such that the nodes of a cell are a range of ids, nodes of a cell keep their order
+	std::vector<uint32_t> nodeOrder() const;
+	///moves the cell of node i to nodeIds[i]
+	void renumber(const std::vector<uint32_t> & nodeIds);
+	void write(std::ostream & out) const;
+private:
+	struct SubGraph;
+	struct BisectionNode;
+private:
+	///@return true for the nodes on the source side of the best cut
+	std::vector<uint8_t> bisect(const SubGraph & g) const;
+	///splits g into the nodes with and without side[i] set
+	static void split(const SubGraph & g, const std::vector<uint8_t> & side, SubGraph & first, SubGraph & second);
+	///assigns the cells of the subtree of node in preorder starting with nextCell
+	void numberCells(std::vector<BisectionNode> & nodes, uint32_t node, uint32_t & nextCell);
+private:
+	const StoredCoordinates * m_coordinates;
+	uint32_t m_nodeCount;
+	uint32_t m_threadCount;
+	std::vector<uint32_t> m_cells;
+	std::vector<TreeNode> m_tree;
+};
+
+}}}//end namespace
+
+#endif
@@ -10,8 +10,13 @@
 #include "GraphWriter.h"
 #include "WeightCalculator.h"
 #include "MaxSpeedParser.h"
+#include "BlockParser.h"
 #include <unordered_set>
+#include <functional>
+#include <map>
 #include <sstream>
+#include <string_view>
+#include <tuple>
 
 
 namespace osm {
@@ -60,147 +65,607 @@ inline std::string tags2json(osmpbf::IPrimitive const & primitive) {
 	return ss.str();
 }
 
-inline bool isUndirectedEdge(const std::unordered_set<int> & implicitOneWay, int ows, int hwType) {
+inline bool isUndirectedEdge(const State::Configuration & cfg, int ows, int hwType) {
 	if (ows == OW_YES) {
 		return false;
 	}
-	if (implicitOneWay.count(hwType)) {
+	if (cfg.isImplicitOneWay(hwType)) {
 		return (ows == OW_NO);
 	}
 	return true;
 }
 
-inline void gatherNodes(osmpbf::PbiStream & inFile, StatePtr state) {
-	osmpbf::PrimitiveBlockInputAdaptor pbi;
-	uint32_t nodeId = 0;
-	inFile.dataSeek(0);
-	sserialize::ProgressInfo progress;
-	progress.begin(state->osmIdToMyNodeId.size(), "Collecting nodes");
-	while (inFile.parseNextBlock(pbi) && nodeId < progress.targetCount) {
-		if (pbi.isNull()) {
-			continue;
+///The nodes of a single PrimitiveBlock that were selected by parseNodes
+struct NodeBatch {
+	struct Entry {
+		int64_t osmId;
+		double lat;
+		double lon;
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		std::string tags;
+		#endif
+	};
+	std::vector<Entry> nodes;
+	inline void clear() { nodes.clear(); }
+};
+
+///Calls consumer(NodeBatch::Entry & node) in file order for every node with filter(osmId) == true
+///that is within the bounds. Reading stops as soon as the consumer returns false.
+///If state->cmd.threadCount > 1 then the blocks are decoded and filtered by worker threads.
+///The filter has to be thread-safe, the consumer is called on the calling thread.
+///The consumer has to check for duplicate nodes from overlapping input files, as these pass the filter as well.
+template<typename TFilter, typename TConsumer>
+void parseNodes(osmpbf::PbiStream & inFile, const BlockIndex & blockIndex, const StatePtr & state, bool withTags, TFilter filter, TConsumer consumer) {
+	bool stopped = false;
+	
+	auto decoder = [&filter, &state, withTags](osmpbf::PrimitiveBlockInputAdaptor & pbi, NodeBatch & batch) {
+		if (pbi.isNull() || !pbi.nodesSize()) {
+			return;
 		}
-		progress(nodeId);
+		for (osmpbf::INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next()) {
+			int64_t osmId = node.id();
+			if (filter(osmId) &&
+				(! state->cmd.withBounds || state->cmd.bounds.contains(node.latd(), node.lond())))
+			{
+				batch.nodes.emplace_back();
+				NodeBatch::Entry & entry = batch.nodes.back();
+				entry.osmId = osmId;
+				entry.lat = node.latd();
+				entry.lon = node.lond();
+				#ifdef CONFIG_CREATOR_COPY_TAGS
+				if (withTags) {
+					entry.tags = tags2json(node);
+				}
+				#else
+				(void) withTags;
+				#endif
+			}
+		}
+	};
+	
+	auto batchConsumer = [&stopped, &consumer](NodeBatch & batch, osmpbf::OffsetType, osmpbf::OffsetType) -> bool {
+		for(NodeBatch::Entry & entry : batch.nodes) {
+			if (!consumer(entry)) {
+				stopped = true;
+				break;
+			}
+		}
+		return !stopped;
+	};
+	
+	blockIndex.forEachRange(BlockIndex::BK_NODES, inFile, [&](osmpbf::OffsetType begin, osmpbf::OffsetType end) {
+		if (stopped) {
+			return;
+		}
+		inFile.dataSeek(begin);
+		if (state->cmd.threadCount > 1) {
+			parseBlocksOrdered<NodeBatch>(inFile, state->cmd.threadCount, decoder, batchConsumer, end);
+		}
+		else {
+			osmpbf::PrimitiveBlockInputAdaptor pbi;
+			NodeBatch batch;
+			osmpbf::OffsetType blockBegin = inFile.dataPosition();
+			while (!stopped && blockBegin < end && inFile.parseNextBlock(pbi)) {
+				osmpbf::OffsetType blockEnd = inFile.dataPosition();
+				batch.clear();
+				decoder(pbi, batch);
+				batchConsumer(batch, blockBegin, blockEnd);
+				blockBegin = blockEnd;
+			}
+		}
+	});
+}
 
-		if (pbi.nodesSize()) {
-			for (osmpbf::INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next()) {
-				int64_t osmId = node.id();
-				if (state->osmIdToMyNodeId.count(osmId)) {
-					Node n(nodeId, osmId, 0);
-					#ifdef CONFIG_CREATOR_COPY_TAGS
-					n.tags = tags2json(node);
-					#endif
-					state->nodes.push_back(n);
-					state->nodeCoordinates.push_back(Coordinates(node.latd(), node.lond()));
-					++nodeId;
-					if (nodeId == 0) { //check for overflow
-						throw std::runtime_error("Too many nodes");
-					}
-					state->osmIdToMyNodeId[n.osmId] = n.id;
+///Assigns node ids to all nodes whose entry in state->osmIdToMyNodeId equals neededNodeMarker
+///and stores them in state->nodes and state->nodeCoordinates.
+///If graphWriter is given then the nodes are written to it in the order of their ids instead of storing them in state->nodes.
+///Node ids are assigned in the order of the input, independent of the number of threads.
+///If the ids of state->osmIdToMyNodeId are given by rank then node ids are in the order of the osm ids,
+///which is the same for inputs sorted by id.
+inline void gatherNodes(osmpbf::PbiStream & inFile, const BlockIndex & blockIndex, StatePtr state, uint32_t neededNodeMarker, uint64_t neededNodeCount, GraphWriter * graphWriter = 0) {
+	const State::OsmIdToMyNodeIdMap & nodeMap = state->osmIdToMyNodeId;
+	uint64_t nodeCount = 0;
+	sserialize::ProgressInfo progress;
+	progress.begin(neededNodeCount, "Collecting nodes");
+	if (nodeMap.idsByRank()) {
+		neededNodeCount = state->osmIdToMyNodeId.assignIdsByRank(neededNodeMarker);
+		if (neededNodeCount >= State::NodeNeeded) {
+			throw std::runtime_error("Too many nodes");
+		}
+		if (!graphWriter) {
+			state->nodes.resize(neededNodeCount);
+		}
+		state->nodeCoordinates.resize(neededNodeCount);
+		//Nodes can only be written in the order of their ids.
+		//Nodes found before all nodes with smaller ids are kept until then, this is only the case for inputs not sorted by id.
+		uint32_t nextWrittenNodeId = 0;
+		std::map<uint32_t, Node> pendingNodes;
+		auto filter = [&nodeMap](int64_t osmId) { return nodeMap.count(osmId) > 0; };
+		parseNodes(inFile, blockIndex, state, true, filter, [&](NodeBatch::Entry & node) {
+			uint32_t nodeId = nodeMap.at(node.osmId);
+			//nodes that already have an id are duplicates from overlapping input files
+			if (graphWriter ? (nodeId < nextWrittenNodeId || pendingNodes.count(nodeId)) : state->nodes[nodeId].id == nodeId) {
+				return true;
+			}
+			Node n(nodeId, node.osmId, 0);
+			#ifdef CONFIG_CREATOR_COPY_TAGS
+			n.tags = std::move(node.tags);
+			#endif
+			state->nodeCoordinates[nodeId] = Coordinates(node.lat, node.lon);
+			if (!graphWriter) {
+				state->nodes[nodeId] = std::move(n);
+			}
+			else if (nodeId == nextWrittenNodeId) {
+				graphWriter->writeNode(n, state->nodeCoordinates[nodeId]);
+				for(++nextWrittenNodeId; pendingNodes.size() && pendingNodes.begin()->first == nextWrittenNodeId; ++nextWrittenNodeId) {
+					graphWriter->writeNode(pendingNodes.begin()->second, state->nodeCoordinates[nextWrittenNodeId]);
+					pendingNodes.erase(pendingNodes.begin());
 				}
 			}
+			else {
+				pendingNodes.emplace(nodeId, std::move(n));
+			}
+			++nodeCount;
+			if (nodeCount % 4096 == 0) {
+				progress(nodeCount);
+			}
+			return nodeCount < neededNodeCount;
+		});
+		if (nodeCount != neededNodeCount) {
+			throw std::runtime_error("Could not find all needed nodes");
 		}
+		assert(pendingNodes.empty());
+	}
+	else {
+		if (graphWriter) {
+			state->nodeCoordinates.reserve(neededNodeCount);
+		}
+		//The status is changed by the consumer while the filter runs in the decoding threads,
+		//hence the filter only checks the set of candidates and the consumer checks the status
+		auto filter = [&nodeMap](int64_t osmId) { return nodeMap.count(osmId) > 0; };
+		parseNodes(inFile, blockIndex, state, true, filter, [&](NodeBatch::Entry & node) {
+			//nodes that are not needed or were already assigned an id (duplicates from overlapping input files) are skipped
+			if (nodeMap.at(node.osmId) != neededNodeMarker) {
+				return true;
+			}
+			uint32_t nodeId = nodeCount;
+			Node n(nodeId, node.osmId, 0);
+			#ifdef CONFIG_CREATOR_COPY_TAGS
+			n.tags = std::move(node.tags);
+			#endif
+			state->nodeCoordinates.push_back(Coordinates(node.lat, node.lon));
+			if (graphWriter) {
+				graphWriter->writeNode(n, state->nodeCoordinates.back());
+			}
+			else {
+				state->nodes.push_back(std::move(n));
+			}
+			state->osmIdToMyNodeId.set(node.osmId, nodeId);
+			++nodeCount;
+			if (nodeCount >= State::NodeNeeded) { //check for overflow
+				throw std::runtime_error("Too many nodes");
+			}
+			if (nodeCount % 4096 == 0) {
+				progress(nodeCount);
+			}
+			return nodeCount < neededNodeCount;
+		});
 	}
 	progress.end();
 }
 
-///deletes all available nodes from state->osmIdToMyNodeId
-inline void deleteAvailableNodes(osmpbf::PbiStream & inFile, StatePtr state) {
-	osmpbf::PrimitiveBlockInputAdaptor pbi;
-	uint32_t nodeId = 0;
-	inFile.dataSeek(0);
+///Removes all nodes from state->nodes and state->nodeCoordinates that are not in neededNodes
+///and assigns new node ids keeping the order of the nodes.
+///Only the entries of the needed nodes in state->osmIdToMyNodeId are updated.
+inline void compactNodes(StatePtr state, const std::vector<bool> & neededNodes) {
+	assert(neededNodes.size() == state->nodes.size());
 	sserialize::ProgressInfo progress;
-	progress.begin(inFile.dataSize(), "Finding unavailable nodes");
-	while (inFile.parseNextBlock(pbi) && nodeId < progress.targetCount) {
-		if (pbi.isNull()) {
+	progress.begin(state->nodes.size(), "Removing unneeded nodes");
+	uint32_t nodeId = 0;
+	for(std::size_t i(0), s(state->nodes.size()); i < s; ++i) {
+		if (!neededNodes[i]) {
 			continue;
 		}
-		progress(inFile.dataPosition());
+		if (nodeId != i) {
+			state->nodes[nodeId] = std::move(state->nodes[i]);
+			state->nodeCoordinates[nodeId] = state->nodeCoordinates[i];
+		}
+		Node & n = state->nodes[nodeId];
+		n.id = nodeId;
+		state->osmIdToMyNodeId.set(n.osmId, nodeId);
+		++nodeId;
+		progress(i);
+	}
+	progress.end();
+	state->nodes.resize(nodeId);
+	state->nodes.shrink_to_fit();
+	state->nodeCoordinates.resize(nodeId);
+	state->nodeCoordinates.shrink_to_fit();
+}
 
-		if (pbi.nodesSize()) {
-			for (osmpbf::INodeStream node = pbi.getNodeStream(); !node.isNull(); node.next()) {
-				int64_t osmId = node.id();
-				if ( (! state->cmd.withBounds || state->cmd.bounds.contains(node.latd(), node.lond())) && state->osmIdToMyNodeId.count(osmId)) {
-					state->osmIdToMyNodeId.unmark(osmId);
-				}
+///Sets all candidate nodes that are available (and within the bounds) to State::NodeAvailable
+///@return the number of available nodes
+inline uint64_t markAvailableNodes(osmpbf::PbiStream & inFile, const BlockIndex & blockIndex, StatePtr state) {
+	uint64_t availableCount = 0;
+	uint64_t candidateCount = state->osmIdToMyNodeId.size();
+	sserialize::ProgressInfo progress;
+	progress.begin(candidateCount, "Finding available nodes");
+	const State::OsmIdToMyNodeIdMap & nodeMap = state->osmIdToMyNodeId;
+	//the status is only read by the consumer, which changes it, see gatherNodes
+	auto filter = [&nodeMap](int64_t osmId) { return nodeMap.count(osmId) > 0; };
+	parseNodes(inFile, blockIndex, state, false, filter, [&](NodeBatch::Entry & node) {
+		//nodes that are already available are duplicates from overlapping input files
+		if (nodeMap.at(node.osmId) != State::NodeCandidate) {
+			return true;
+		}
+		state->osmIdToMyNodeId.set(node.osmId, State::NodeAvailable);
+		++availableCount;
+		if (availableCount % 4096 == 0) {
+			progress(availableCount);
+		}
+		return availableCount < candidateCount;
+	});
+	progress.end();
+	return availableCount;
+}
+
+///The tags of a way whose keys were requested by the processors with keysToStore().
+///Keys point to the strings of keysToStore(), values point into the block or batch of the way.
+///Both are only valid during the call of the processor.
+///If maxspeed is requested then its value is parsed once for every distinct value of a block.
+class StoredTags {
+public:
+	typedef std::pair<const std::string *, std::string_view> KeyValue;
+	typedef std::vector<KeyValue>::const_iterator const_iterator;
+public:
+	StoredTags() {}
+	inline void clear() {
+		m_kv.clear();
+		m_hasMaxSpeed = false;
+		m_maxSpeed = 0;
+	}
+	inline void add(const std::string * key, std::string_view value) { m_kv.emplace_back(key, value); }
+	inline const_iterator begin() const { return m_kv.begin(); }
+	inline const_iterator end() const { return m_kv.end(); }
+	inline std::size_t size() const { return m_kv.size(); }
+	///@return the value of key or 0 if the way has no such tag
+	inline const std::string_view * find(std::string_view key) const {
+		for(const KeyValue & kv : m_kv) {
+			if (*kv.first == key) {
+				return &kv.second;
 			}
 		}
+		return 0;
 	}
-	progress.end();
+	inline void setMaxSpeed(bool valid, int maxSpeed) {
+		m_hasMaxSpeed = valid;
+		m_maxSpeed = maxSpeed;
+	}
+	///@return false if the way has no valid maxspeed tag
+	inline bool maxSpeed(int & maxSpeed) const {
+		maxSpeed = m_maxSpeed;
+		return m_hasMaxSpeed;
+	}
+private:
+	std::vector<KeyValue> m_kv;
+	bool m_hasMaxSpeed{false};
+	int m_maxSpeed{0};
+};
+
+///Gets the maxspeed of way from its stored maxspeed tag in km/h
+///@return false if the way has no valid maxspeed tag
+template<typename TWay>
+inline bool wayMaxSpeed(const StoredTags & storedKv, const TWay & /*way*/, int & maxSpeed) {
+	return storedKv.maxSpeed(maxSpeed);
 }
 
+///@return the number of edges way contributes to the graph
+template<typename TWay>
+inline uint64_t wayEdgeCount(const StatePtr & state, int ows, int hwType, const TWay & way) {
+	assert(way.refsSize() > 0);
+	uint64_t myEdgeCount = way.refsSize()-1;
+	if (state->cmd.addReverseEdges && isUndirectedEdge(state->cfg, ows, hwType)) {
+		myEdgeCount *= 2;
+	}
+	return myEdgeCount;
+}
+
+///A way decoded by WayParser and detached from its PrimitiveBlock.
+///Provides the part of the osmpbf::IWay interface used by the way processors
+class ParsedWay {
+public:
+	typedef const int64_t * RefIterator;
+public:
+	ParsedWay(int64_t id, RefIterator refBegin, RefIterator refEnd) :
+	m_id(id), m_refBegin(refBegin), m_refEnd(refEnd) {}
+	inline int64_t id() const { return m_id; }
+	inline RefIterator refBegin() const { return m_refBegin; }
+	inline RefIterator refEnd() const { return m_refEnd; }
+	inline int refsSize() const { return m_refEnd - m_refBegin; }
+#ifdef CONFIG_CREATOR_COPY_TAGS
+	inline const std::string & tags() const { return *m_tags; }
+	inline void setTags(const std::string * tags) { m_tags = tags; }
+#endif
+private:
+	int64_t m_id;
+	RefIterator m_refBegin;
+	RefIterator m_refEnd;
+#ifdef CONFIG_CREATOR_COPY_TAGS
+	const std::string * m_tags{0};
+#endif
+};
+
+#ifdef CONFIG_CREATOR_COPY_TAGS
+inline std::string tags2json(const ParsedWay & way) {
+	return way.tags();
+}
+#endif
+
+///The ways of a single PrimitiveBlock that were accepted by WayParser
+struct WayBatch {
+	struct Entry {
+		int64_t id;
+		OneWayStatus ows;
+		int hwType;
+		std::size_t refsBegin;
+		std::size_t refsEnd;
+		std::size_t storedBegin;
+		std::size_t storedEnd;
+		bool hasMaxSpeed;
+		int maxSpeed;
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		std::string tags;
+		#endif
+	};
+	std::vector<Entry> ways;
+	std::vector<int64_t> refs; //refs of all ways
+	std::vector<std::pair<const std::string *, std::size_t>> storedKeys; //stored keys of all ways and the end of their value in storedValues
+	std::string storedValues; //stored values of all ways
+	uint8_t blockKinds{BlockIndex::BK_NONE};
+	inline void clear() {
+		ways.clear();
+		refs.clear();
+		storedKeys.clear();
+		storedValues.clear();
+		blockKinds = BlockIndex::BK_NONE;
+	}
+};
+
+///Updates progress, the result of status is shown with it if status is set
+inline void updateProgress(sserialize::ProgressInfo & progress, uint64_t position, const std::function<std::string()> & status) {
+	if (status) {
+		progress(position, status());
+	}
+	else {
+		progress(position);
+	}
+}
+
+///Calls processor(ows, hwType, storedKv, way) for every highway way in the input.
+///If threadCount > 1 then blocks are decoded and matched by threadCount worker threads.
+///The processor is always called from the calling thread and sees the ways in file order.
+///If blockIndex is given and valid then only blocks containing ways are read,
+///if it is not valid yet then it is filled.
 struct WayParser {
-	WayParser(const std::string & message, osmpbf::PbiStream & inFile, const std::unordered_map<std::string, int> & hwTagIds) :
-	message(message), inFile(inFile), hwTagIds(hwTagIds) {}
+	WayParser(const std::string & message, osmpbf::PbiStream & inFile, const std::unordered_map<std::string, int> & hwTagIds, uint32_t threadCount = 1, BlockIndex * blockIndex = 0) :
+	message(message), inFile(inFile), hwTagIds(hwTagIds), threadCount(threadCount), blockIndex(blockIndex) {}
 	std::string message;
 	osmpbf::PbiStream & inFile;
 	std::unordered_map<std::string, int> hwTagIds;
+	uint32_t threadCount;
+	BlockIndex * blockIndex;
+	std::function<std::string()> progressStatus; ///shown with the progress if set
+	
+	///Calls callback(ows, hwType, storedKv, way) for every highway way in pbi, this is thread-safe.
+	///Apart from the tables of the block there are no heap allocations once storedKv has grown to the number of stored keys.
+	template<typename TCALLBACK>
+	void parseBlock(osmpbf::PrimitiveBlockInputAdaptor & pbi, const std::unordered_set<std::string> & keysToStore, TCALLBACK & callback) const {
+		constexpr int MaxSpeedUnknown = std::numeric_limits<int>::min();
+		constexpr int MaxSpeedInvalid = std::numeric_limits<int>::min()+1;
+		
+		uint32_t highwayTagId = pbi.findString("highway");
+		
+		if (highwayTagId == 0)
+			return;
+		uint32_t onewayTagId = pbi.findString("oneway");
+		uint32_t maxSpeedTagId = keysToStore.count("maxspeed") ? pbi.findString("maxspeed") : 0;
+		
+		//tables indexed by string id
+		std::size_t stringTableSize = pbi.stringTableSize();
+		std::vector<int> strIdToHwId(stringTableSize, -1);
+		std::vector<const std::string *> strIdToStoredKey(stringTableSize, 0);
+		std::vector<int> strIdToMaxSpeed(maxSpeedTagId ? stringTableSize : 0, MaxSpeedUnknown);
+		for(std::size_t i = 0; i < stringTableSize; ++i) {
+			const std::string & str = pbi.queryStringTable(i);
+			auto hwIt = hwTagIds.find(str);
+			if (hwIt != hwTagIds.end()) {
+				strIdToHwId[i] = hwIt->second;
+			}
+			auto keyIt = keysToStore.find(str);
+			if (keyIt != keysToStore.end()) {
+				strIdToStoredKey[i] = &(*keyIt);
+			}
+		}
+
+		StoredTags storedKv;
+		if (pbi.waysSize()) {
+			for (osmpbf::IWayStream way = pbi.getWayStream(); !way.isNull(); way.next()) {
+				OneWayStatus ows = OW_IMPLICIT;
+				int hwType = 0;
+				bool process = false;
+				storedKv.clear();
+				for(int i = 0, s = way.tagsSize(); i < s; ++i) {
+					uint32_t keyId = way.keyId(i);
+					if (keyId == onewayTagId) {
+						ows = (toBool(way.value(i) ) > 0 ? OW_YES : OW_NO);
+					}
+					else if (keyId == highwayTagId) {
+						uint32_t valueId = way.valueId(i);
+						if (strIdToHwId[valueId] >= 0 && way.refsSize() > 1) {
+							hwType = strIdToHwId[valueId];
+							process = true;
+						}
+						else {
+							break;
+						}
+					}
+					if(strIdToStoredKey[keyId]) {
+						uint32_t valueId = way.valueId(i);
+						const std::string & value = pbi.queryStringTable(valueId);
+						storedKv.add(strIdToStoredKey[keyId], value);
+						if (keyId == maxSpeedTagId) {
+							int & maxSpeed = strIdToMaxSpeed[valueId];
+							if (maxSpeed == MaxSpeedUnknown) {
+								int tmp;
+								maxSpeed = (parseMaxSpeed(value, tmp) ? tmp : MaxSpeedInvalid);
+							}
+							storedKv.setMaxSpeed(maxSpeed != MaxSpeedInvalid, maxSpeed != MaxSpeedInvalid ? maxSpeed : 0);
+						}
+					}
+				}
+				if (process) {
+					callback(ows, hwType, storedKv, way);
+				}
+			}
+		}
+	}
 	
 	template<typename TOPERATOR>
 	void parse(TOPERATOR & processor) {
-		std::unordered_map<int, int> strIdToHwId;
-		std::unordered_set<int> keysToStore;
-		std::unordered_map<std::string, std::string> storedKv;
-		osmpbf::PrimitiveBlockInputAdaptor pbi;
-
+		bool fillIndex = blockIndex && !blockIndex->valid();
 		sserialize::ProgressInfo progress;
 		progress.begin(inFile.dataSize(), message);
-		while (inFile.parseNextBlock(pbi)) {
+		auto parseRange = [&](osmpbf::OffsetType begin, osmpbf::OffsetType end) {
+			inFile.dataSeek(begin);
+			if (threadCount > 1) {
+				parseParallel(processor, end, progress);
+			}
+			else {
+				parseSerial(processor, end, progress);
+			}
+		};
+		if (blockIndex) {
+			blockIndex->forEachRange(BlockIndex::BK_WAYS, inFile, parseRange);
+		}
+		else {
+			parseRange(0, inFile.dataSize());
+		}
+		if (fillIndex) {
+			blockIndex->finish();
+		}
+		progress.end();
+	}
+	
+	template<typename TOPERATOR>
+	void parseSerial(TOPERATOR & processor, osmpbf::OffsetType end, sserialize::ProgressInfo & progress) {
+		bool fillIndex = blockIndex && !blockIndex->valid();
+		osmpbf::PrimitiveBlockInputAdaptor pbi;
+		osmpbf::OffsetType blockBegin = inFile.dataPosition();
+		while (blockBegin < end && inFile.parseNextBlock(pbi)) {
+			osmpbf::OffsetType blockEnd = inFile.dataPosition();
+			if (fillIndex) {
+				blockIndex->add(blockBegin, blockEnd, pbi);
+			}
+			blockBegin = blockEnd;
 			if (pbi.isNull())
 				continue;
-			uint32_t highwayTagId = pbi.findString("highway");
-			
-			if (highwayTagId == 0)
-				continue;
-			uint32_t onewayTagId = pbi.findString("oneway");
-				
-			strIdToHwId.clear();
-			for(int i = 0, s = pbi.stringTableSize(); i < s; ++i) {
-				const std::string & str = pbi.queryStringTable(i);
-				if (hwTagIds.count(str) > 0) {
-					strIdToHwId[i] = hwTagIds.at(str);
+			updateProgress(progress, blockEnd, progressStatus);
+			parseBlock(pbi, processor.keysToStore(), processor);
+		}
+	}
+	
+	template<typename TOPERATOR>
+	void parseParallel(TOPERATOR & processor, osmpbf::OffsetType end, sserialize::ProgressInfo & progress) {
+		bool fillIndex = blockIndex && !blockIndex->valid();
+		const std::unordered_set<std::string> & keysToStore = processor.keysToStore();
+		
+		auto decoder = [this, &keysToStore](osmpbf::PrimitiveBlockInputAdaptor & pbi, WayBatch & batch) {
+			if (pbi.isNull()) {
+				return;
+			}
+			batch.blockKinds |= (pbi.nodesSize() ? BlockIndex::BK_NODES : BlockIndex::BK_NONE);
+			batch.blockKinds |= (pbi.waysSize() ? BlockIndex::BK_WAYS : BlockIndex::BK_NONE);
+			batch.blockKinds |= (pbi.relationsSize() ? BlockIndex::BK_RELATIONS : BlockIndex::BK_NONE);
+			auto collector = [&batch](OneWayStatus ows, int hwType, const StoredTags & storedKv, const osmpbf::IWay & way) {
+				batch.ways.emplace_back();
+				WayBatch::Entry & entry = batch.ways.back();
+				entry.id = way.id();
+				entry.ows = ows;
+				entry.hwType = hwType;
+				entry.storedBegin = batch.storedKeys.size();
+				for(const StoredTags::KeyValue & kv : storedKv) {
+					batch.storedValues.append(kv.second.data(), kv.second.size());
+					batch.storedKeys.emplace_back(kv.first, batch.storedValues.size());
 				}
-				if (processor.keysToStore().count(str)) {
-					keysToStore.insert(i);
+				entry.storedEnd = batch.storedKeys.size();
+				entry.hasMaxSpeed = storedKv.maxSpeed(entry.maxSpeed);
+				#ifdef CONFIG_CREATOR_COPY_TAGS
+				entry.tags = tags2json(way);
+				#endif
+				entry.refsBegin = batch.refs.size();
+				for(osmpbf::IWayStream::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+					batch.refs.push_back(*refIt);
 				}
+				entry.refsEnd = batch.refs.size();
+			};
+			parseBlock(pbi, keysToStore, collector);
+		};
+		
+		StoredTags storedKv;
+		auto consumer = [this, fillIndex, &processor, &progress, &storedKv](WayBatch & batch, osmpbf::OffsetType blockBegin, osmpbf::OffsetType blockEnd) {
+			if (fillIndex) {
+				blockIndex->add(blockBegin, blockEnd, batch.blockKinds);
 			}
-
-			progress(inFile.dataPosition());
-			if (pbi.waysSize()) {
-				for (osmpbf::IWayStream way = pbi.getWayStream(); !way.isNull(); way.next()) {
-					OneWayStatus ows = OW_IMPLICIT;
-					int hwType = 0;
-					bool process = false;
-					for(int i = 0, s = way.tagsSize(); i < s; ++i) {
-						uint32_t keyId = way.keyId(i);
-						if (keyId == onewayTagId) {
-							ows = (toBool(way.value(i) ) > 0 ? OW_YES : OW_NO);
-						}
-						else if (keyId == highwayTagId) {
-							uint32_t valueId = way.valueId(i);
-							if ( strIdToHwId.count( valueId ) && way.refsSize() > 1) {
-								hwType = strIdToHwId[valueId];
-								process = true;
-							}
-							else {
-								break;
-							}
-						}
-						if(keysToStore.count(keyId)) {
-							storedKv[way.key(i)] = way.value(i);
-						}
-					}
-					if (process) {
-						processor(ows, hwType, storedKv, way);
-					}
-					storedKv.clear();
+			updateProgress(progress, blockEnd, progressStatus);
+			for(const WayBatch::Entry & entry : batch.ways) {
+				ParsedWay way(entry.id, batch.refs.data()+entry.refsBegin, batch.refs.data()+entry.refsEnd);
+				#ifdef CONFIG_CREATOR_COPY_TAGS
+				way.setTags(&entry.tags);
+				#endif
+				storedKv.clear();
+				for(std::size_t i(entry.storedBegin); i < entry.storedEnd; ++i) {
+					std::size_t valueBegin = (i ? batch.storedKeys[i-1].second : 0);
+					std::size_t valueEnd = batch.storedKeys[i].second;
+					storedKv.add(batch.storedKeys[i].first, std::string_view(batch.storedValues.data()+valueBegin, valueEnd-valueBegin));
 				}
+				storedKv.setMaxSpeed(entry.hasMaxSpeed, entry.maxSpeed);
+				processor(entry.ows, entry.hwType, storedKv, way);
 			}
-		}
-		progress.end();
+		};
+		parseBlocksOrdered<WayBatch>(inFile, threadCount, decoder, consumer, end);
 	}
 };
 
+///Calls multiple processors for each way so that they share a single scan of the input.
+///The processors are called in the given order, hence a processor sees the changes
+///that the processors before it made for the same way.
+template<typename... TProcessors>
+struct ProcessorChain {
+	ProcessorChain(TProcessors & ... processors) :
+	processors(processors...)
+	{
+		std::apply([this](auto & ... p) {
+			(kS.insert(p.keysToStore().begin(), p.keysToStore().end()), ...);
+		}, this->processors);
+	}
+	std::tuple<TProcessors & ...> processors;
+	
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+	
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & storedKv, const TWay & way) {
+		std::apply([&](auto & ... p) {
+			(p(ows, hwType, storedKv, way), ...);
+		}, processors);
+	}
+};
+
+template<typename... TProcessors>
+ProcessorChain<TProcessors...> chainProcessors(TProcessors & ... processors) {
+	return ProcessorChain<TProcessors...>(processors...);
+}
+
 ///Get the min/max node id
 struct MinMaxNodeIdProcessor {
 	MinMaxNodeIdProcessor() {}
@@ -213,8 +678,9 @@ struct MinMaxNodeIdProcessor {
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int /*ows*/, int /*hwType*/, const std::unordered_map<std::string, std::string> & /*storedKv*/, const osmpbf::IWay & way) {
-		for(osmpbf::IWayStream::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+	template<typename TWay>
+	inline void operator()(int /*ows*/, int /*hwType*/, const StoredTags & /*storedKv*/, const TWay & way) {
+		for(typename TWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
 			int64_t refId = *refIt;
 			largestId.update(refId);
 			smallestId.update(refId);
@@ -223,7 +689,7 @@ struct MinMaxNodeIdProcessor {
 	}
 };
 
-///Marks all nodes needed by valid ways into state->osmIdToMyNodeId
+///Marks all nodes referenced by ways as State::NodeCandidate in state->osmIdToMyNodeId
 struct AllNodesGatherProcessor {
 	AllNodesGatherProcessor(StatePtr state) :
 	state(state) {}
@@ -232,40 +698,87 @@ struct AllNodesGatherProcessor {
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int /*ows*/, int /*hwType*/, const std::unordered_map<std::string, std::string> & /*storedKv*/, const osmpbf::IWay & way) {
-		for(osmpbf::IWayStream::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
-			state->osmIdToMyNodeId.mark(*refIt);
+	template<typename TWay>
+	inline void operator()(int /*ows*/, int /*hwType*/, const StoredTags & /*storedKv*/, const TWay & way) {
+		for(typename TWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+			state->osmIdToMyNodeId.set(*refIt, State::NodeCandidate);
 		}
 	}
 };
 
-///Marks all nodes needed by valid ways into state->osmIdToMyNodeId
+///Adds the edges of all ways to state->edgeCount
+struct EdgeCountProcessor {
+	EdgeCountProcessor(StatePtr state) :
+	state(state) {}
+	StatePtr state;
+	
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+	
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		state->edgeCount += wayEdgeCount(state, ows, hwType, way);
+	}
+};
+
+///Marks all nodes needed by valid ways as State::NodeNeeded in state->osmIdToMyNodeId
 ///BUT taking invalid ways into account and updating edgeCount
 struct NodeRefGatherProcessor {
 	NodeRefGatherProcessor(StatePtr state) :
 	state(state) {}
 	StatePtr state;
+	uint64_t neededNodeCount{0};
+	
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
 	
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int ows, int hwType, const std::unordered_map<std::string, std::string> & /*storedKv*/, const osmpbf::IWay & way) {
-		if (state->invalidWays.count(way.id())) { //check if way is valid
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal)) { //check if way is valid
 			return;
 		}
-		for(osmpbf::IWayStream::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
-			state->osmIdToMyNodeId.mark(*refIt);
+		for(typename TWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+			if (state->osmIdToMyNodeId.at(*refIt) != State::NodeNeeded) {
+				state->osmIdToMyNodeId.set(*refIt, State::NodeNeeded);
+				++neededNodeCount;
+			}
 		}
-		assert(way.refsSize() > 0);
-		uint64_t myEdgeCount = way.refsSize()-1;
-		if (state->cmd.addReverseEdges && isUndirectedEdge(state->cfg.implicitOneWay, ows, hwType)) {
-			myEdgeCount *= 2;
+		state->edgeCount += wayEdgeCount(state, ows, hwType, way);
+	}
+};
+
+///Same as NodeRefGatherProcessor, but for nodes that were already collected by gatherNodes.
+///Marks the nodes of valid ways in neededNodes
+struct CollectedNodeRefGatherProcessor {
+	CollectedNodeRefGatherProcessor(StatePtr state) :
+	state(state),
+	neededNodes(state->nodes.size(), false)
+	{}
+	StatePtr state;
+	std::vector<bool> neededNodes;
+	
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+	
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal)) { //check if way is valid
+			return;
+		}
+		for(typename TWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+			neededNodes[state->osmIdToMyNodeId.at(*refIt)] = true;
 		}
-		state->edgeCount += myEdgeCount;
+		state->edgeCount += wayEdgeCount(state, ows, hwType, way);
 	}
 };
 
-///This marks ways invalid if a node is in state->osmIdToMyNodeId and in the way
+///This marks ways invalid if one of its nodes is still a State::NodeCandidate, i.e. it is not available
 struct InvalidWayMarkingProcessor {
 	InvalidWayMarkingProcessor(StatePtr state) :
 	state(state)
@@ -273,13 +786,17 @@ struct InvalidWayMarkingProcessor {
 	
 	StatePtr state;
 
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int /*ows*/, int /*hwType*/, const std::unordered_map<std::string, std::string> & /*storedKv*/, const osmpbf::IWay & way) {
-		for(osmpbf::IWayStream::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
-			if (state->osmIdToMyNodeId.count(*refIt)) {
-				state->invalidWays.insert(way.id());
+	template<typename TWay>
+	inline void operator()(int /*ows*/, int /*hwType*/, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		for(typename TWay::RefIterator refIt(way.refBegin()), refEnd(way.refEnd()); refIt != refEnd; ++refIt) {
+			if (state->osmIdToMyNodeId.at(*refIt) == State::NodeCandidate) {
+				state->invalidWays.insert(ordinal);
 				return;
 			}
 		}
@@ -292,15 +809,19 @@ struct NodeDegreeProcessor {
 	{}
 	
 	StatePtr state;
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int ows, int hwType, const std::unordered_map<std::string, std::string> & /*storedKv*/, const osmpbf::IWay & way) {
-		if (state->invalidWays.count(way.id()) == 0) {
-			bool undirectEdge = isUndirectedEdge(state->cfg.implicitOneWay, ows, hwType);
-			osmpbf::IWayStream::RefIterator refSrc(way.refBegin());
-			osmpbf::IWayStream::RefIterator refTg(way.refBegin()); ++refTg;
-			osmpbf::IWayStream::RefIterator refEnd(way.refEnd());
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
+			bool undirectEdge = isUndirectedEdge(state->cfg, ows, hwType);
+			typename TWay::RefIterator refSrc(way.refBegin());
+			typename TWay::RefIterator refTg(way.refBegin()); ++refTg;
+			typename TWay::RefIterator refEnd(way.refEnd());
 			for(; refTg != refEnd; ++refTg, ++refSrc) {
 				Edge e(state->osmIdToMyNodeId.at(*refSrc), state->osmIdToMyNodeId.at(*refTg), 1, hwType, 0);
 				#ifdef CONFIG_SUPPORT_SSERIALIZE_OFFSET_ARRAY_TARGET
@@ -319,45 +840,327 @@ struct NodeDegreeProcessor {
 	};
 };
 
+///Finds the nodes removed by cmd.contractChains and sets state->writtenNodeIds in finish().
+///A node is removed if it is an inner node of a way and no other way segment touches it,
+///i.e. it is no way end and has exactly two incident segments which belong to the same way
+struct ChainNodeProcessor {
+	ChainNodeProcessor(StatePtr state, uint64_t nodeCount) :
+	state(state),
+	incidences(nodeCount, 0)
+	{}
+
+	StatePtr state;
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	///bits 0-1: number of incident way segments saturated at 3, bit 2: the last way touching the node has reverse edges
+	std::vector<uint8_t> incidences;
+
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
+			uint8_t reverse = (state->cmd.addReverseEdges && isUndirectedEdge(state->cfg, ows, hwType)) ? 0x4 : 0x0;
+			typename TWay::RefIterator refSrc(way.refBegin());
+			typename TWay::RefIterator refTg(way.refBegin()); ++refTg;
+			typename TWay::RefIterator refEnd(way.refEnd());
+			uint32_t first = state->osmIdToMyNodeId.at(*refSrc);
+			uint32_t last = first;
+			for(; refTg != refEnd; ++refTg, ++refSrc) {
+				add(state->osmIdToMyNodeId.at(*refSrc), reverse);
+				last = state->osmIdToMyNodeId.at(*refTg);
+				add(last, reverse);
+			}
+			//way ends are always kept
+			incidences.at(first) |= 0x3;
+			incidences.at(last) |= 0x3;
+		}
+	};
+
+	///Assigns the ids of the remaining nodes and removes the merged edges from state->edgeCount
+	///@return the number of remaining nodes
+	uint32_t finish() {
+		uint32_t nodeCount = 0;
+		uint64_t removedEdges = 0;
+		state->writtenNodeIds.resize(incidences.size());
+		for(std::size_t i(0), s(incidences.size()); i < s; ++i) {
+			if ((incidences[i] & 0x3) == 2) {
+				state->writtenNodeIds[i] = State::ContractedNode;
+				//the two segments of the node become one edge, twice if the way has reverse edges
+				removedEdges += (incidences[i] & 0x4) ? 2 : 1;
+			}
+			else {
+				state->writtenNodeIds[i] = nodeCount++;
+			}
+		}
+		state->edgeCount -= removedEdges;
+		incidences = std::vector<uint8_t>();
+		return nodeCount;
+	}
+private:
+	inline void add(uint32_t node, uint8_t reverse) {
+		uint8_t & x = incidences.at(node);
+		x = std::min<uint8_t>((x & 0x3) + 1, 3) | reverse;
+	}
+};
+
+///Counts the out-degree of every node in the same way as FinalWayProcessor writes the edges.
+///offsets() turns the degrees into the position of the first edge of every node in a graph sorted by source
+struct EdgeOffsetProcessor {
+	EdgeOffsetProcessor(StatePtr state, uint64_t nodeCount) :
+	state(state),
+	degrees(nodeCount+1, 0)
+	{}
+
+	StatePtr state;
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	std::vector<uint64_t> degrees; ///degrees[i+1] is the out-degree of node i
+
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
+			bool reverse = state->cmd.addReverseEdges && isUndirectedEdge(state->cfg, ows, hwType);
+			typename TWay::RefIterator refSrc(way.refBegin());
+			typename TWay::RefIterator refTg(way.refBegin()); ++refTg;
+			typename TWay::RefIterator refEnd(way.refEnd());
+			if (state->writtenNodeIds.size()) {
+				//edges of contracted chains connect the remaining nodes
+				uint32_t source = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refSrc));
+				for(; refTg != refEnd; ++refTg) {
+					uint32_t target = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refTg));
+					if (target == State::ContractedNode) {
+						continue;
+					}
+					degrees.at(source+1) += 1;
+					if (reverse) {
+						degrees.at(target+1) += 1;
+					}
+					source = target;
+				}
+				return;
+			}
+			for(; refTg != refEnd; ++refTg, ++refSrc) {
+				degrees.at(state->osmIdToMyNodeId.at(*refSrc)+1) += 1;
+				if (reverse) {
+					degrees.at(state->osmIdToMyNodeId.at(*refTg)+1) += 1;
+				}
+			}
+		}
+	};
+
+	///@return the prefix sums of the out-degrees, the last entry is the number of edges
+	std::vector<uint64_t> offsets() {
+		for(std::size_t i(1), s(degrees.size()); i < s; ++i) {
+			degrees[i] += degrees[i-1];
+		}
+		return std::move(degrees);
+	}
+};
+
+///Collects the edges that replace contracted chains for the ShapeFileWriter, see ShapeFileWriter::setChainEdges()
+struct ChainEdgeProcessor {
+	ChainEdgeProcessor(StatePtr state) : state(state) {}
+
+	StatePtr state;
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	std::vector<uint64_t> chainEdges; ///(source << 32 | target) of the edges and their reverse edges
+
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
+			bool reverse = state->cmd.addReverseEdges && isUndirectedEdge(state->cfg, ows, hwType);
+			typename TWay::RefIterator refTg(way.refBegin());
+			typename TWay::RefIterator refEnd(way.refEnd());
+			uint32_t source = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refTg));
+			bool contracted = false;
+			for(++refTg; refTg != refEnd; ++refTg) {
+				uint32_t target = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refTg));
+				if (target == State::ContractedNode) {
+					contracted = true;
+					continue;
+				}
+				if (contracted) {
+					chainEdges.push_back((uint64_t(source) << 32) | target);
+					if (reverse) {
+						chainEdges.push_back((uint64_t(target) << 32) | source);
+					}
+				}
+				source = target;
+				contracted = false;
+			}
+		}
+	};
+
+	///@return the sorted and unique chain edges
+	std::vector<uint64_t> finish() {
+		std::sort(chainEdges.begin(), chainEdges.end());
+		chainEdges.erase(std::unique(chainEdges.begin(), chainEdges.end()), chainEdges.end());
+		chainEdges.shrink_to_fit();
+		return std::move(chainEdges);
+	}
+};
+
+///Collects the edges of the written graph for the Partitioner, every pair of nodes connected by a way segment is added once
+struct PartitionEdgeProcessor {
+	PartitionEdgeProcessor(StatePtr state) : state(state) {}
+
+	StatePtr state;
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	std::vector< std::pair<uint32_t, uint32_t> > edges;
+
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+
+	template<typename TWay>
+	inline void operator()(int /*ows*/, int /*hwType*/, const StoredTags & /*storedKv*/, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
+			typename TWay::RefIterator refSrc(way.refBegin());
+			typename TWay::RefIterator refTg(way.refBegin()); ++refTg;
+			typename TWay::RefIterator refEnd(way.refEnd());
+			if (state->writtenNodeIds.size()) {
+				//edges of contracted chains connect the remaining nodes
+				uint32_t source = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refSrc));
+				for(; refTg != refEnd; ++refTg) {
+					uint32_t target = state->writtenNodeIds.at(state->osmIdToMyNodeId.at(*refTg));
+					if (target == State::ContractedNode) {
+						continue;
+					}
+					edges.emplace_back(source, target);
+					source = target;
+				}
+				return;
+			}
+			for(; refTg != refEnd; ++refTg, ++refSrc) {
+				edges.emplace_back(state->osmIdToMyNodeId.at(*refSrc), state->osmIdToMyNodeId.at(*refTg));
+			}
+		}
+	};
+};
+
+///Writes the edges of all valid ways.
+///The weights of the edges are calculated in batches, call flush() after the last way
 struct FinalWayProcessor {
-	FinalWayProcessor(StatePtr state, std::shared_ptr<GraphWriter> graphWriter, std::shared_ptr<WeightCalculator> weightCalculator) :
-	state(state), graphWriter(graphWriter), weightCalculator(weightCalculator)
+	static constexpr std::size_t BatchSize = 4096;
+	///@param shapeWriter receives the inner points of contracted chains, may be null. Its chain edges have to be set
+	FinalWayProcessor(StatePtr state, std::shared_ptr<GraphWriter> graphWriter, std::shared_ptr<WeightCalculator> weightCalculator,
+		std::shared_ptr<ShapeFileWriter> shapeWriter = std::shared_ptr<ShapeFileWriter>()) :
+	state(state), graphWriter(graphWriter), weightCalculator(weightCalculator), shapeWriter(shapeWriter)
 	{
 		kS.insert("maxspeed");
+		edges.reserve(BatchSize);
+		writeReverse.reserve(BatchSize);
+		chainContinues.reserve(BatchSize);
+		writtenEdges.reserve(2*BatchSize);
 	}
 	
 	StatePtr state;
 	std::shared_ptr< GraphWriter > graphWriter;
 	std::shared_ptr< WeightCalculator > weightCalculator;
+	std::shared_ptr< ShapeFileWriter > shapeWriter;
+	
+	uint64_t wayOrdinal{0}; ///position of the current way in the way pass
+	std::vector<Edge> edges; ///edges whose weight is not calculated yet
+	std::vector<bool> writeReverse; ///write the reverse of edges[i] after it
+	std::vector<bool> chainContinues; ///the target of edges[i] is contracted, edges[i+1] continues the chain
+	std::vector<Coordinates> shapePoints; ///inner points of the current chain
+	uint32_t shapeSource{0}; ///first node of the current chain
+	std::vector<Edge> writtenEdges; ///edges of a batch in the order they are written
 	
 	std::unordered_set<std::string> kS;
 	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
 	
-	inline void operator()(int ows, int hwType, const std::unordered_map<std::string, std::string> & storedKv, const osmpbf::IWay & way) {
-		if (state->invalidWays.count(way.id()) == 0) {
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & storedKv, const TWay & way) {
+		uint64_t ordinal = wayOrdinal++;
+		if (state->invalidWays.count(ordinal) == 0) {
 			int maxSpeed = 0;
-			if (!storedKv.count("maxspeed") || !parseMaxSpeed(storedKv.at("maxspeed"), maxSpeed)) {
+			if (!wayMaxSpeed(storedKv, way, maxSpeed)) {
 				maxSpeed = state->cfg.maxSpeedFromType(hwType);
 			}
 			#ifdef CONFIG_CREATOR_COPY_TAGS
 			std::string tags = tags2json(way);
 			#endif
-			osmpbf::IWayStream::RefIterator refSrc(way.refBegin());
-			osmpbf::IWayStream::RefIterator refTg(way.refBegin()); ++refTg;
-			osmpbf::IWayStream::RefIterator refEnd(way.refEnd());
+			bool reverse = state->cmd.addReverseEdges && isUndirectedEdge(state->cfg, ows, hwType);
+			typename TWay::RefIterator refSrc(way.refBegin());
+			typename TWay::RefIterator refTg(way.refBegin()); ++refTg;
+			typename TWay::RefIterator refEnd(way.refEnd());
 			for(; refTg != refEnd; ++refTg, ++refSrc) {
-				Edge e(state->osmIdToMyNodeId.at(*refSrc), state->osmIdToMyNodeId.at(*refTg), 1, hwType, maxSpeed);
+				edges.emplace_back(state->osmIdToMyNodeId.at(*refSrc), state->osmIdToMyNodeId.at(*refTg), 1, hwType, maxSpeed);
 				#ifdef CONFIG_CREATOR_COPY_TAGS
-				e.tags = tags;
+				edges.back().tags = tags;
 				#endif
-				e.weight = weightCalculator->calc(e);
-				graphWriter->writeEdge(e);
-				if (state->cmd.addReverseEdges && isUndirectedEdge(state->cfg.implicitOneWay, ows, hwType)) {
-					graphWriter->writeEdge(e.reverse());
-				}
+				writeReverse.push_back(reverse);
+				chainContinues.push_back(state->writtenNodeIds.size() && state->writtenNodeIds.at(edges.back().target) == State::ContractedNode);
+			}
+			if (edges.size() >= BatchSize) {
+				flush();
 			}
 		}
 	};
+	
+	///Calculates the weights of the buffered edges and writes them together with their reverse edges
+	void flush() {
+		weightCalculator->calc(edges.data(), edges.data()+edges.size());
+		for(std::size_t i(0), s(edges.size()); i < s; ++i) {
+			if (state->writtenNodeIds.size()) {
+				contractChain(i);
+			}
+			if (shapeWriter) {
+				writeShape(i);
+			}
+			if (writeReverse[i]) {
+				writtenEdges.push_back(edges[i]);
+				writtenEdges.push_back(std::move(edges[i].reverse()));
+			}
+			else {
+				writtenEdges.push_back(std::move(edges[i]));
+			}
+		}
+		graphWriter->writeEdges(writtenEdges.data(), writtenEdges.size());
+		edges.clear();
+		writeReverse.clear();
+		chainContinues.clear();
+		writtenEdges.clear();
+	}
+private:
+	///Merges the chain starting at edges[i] into its last edge, sets i to this edge and maps its nodes to state->writtenNodeIds.
+	///Chains never cross ways, hence they are never split by flush()
+	void contractChain(std::size_t & i) {
+		std::size_t first = i;
+		uint32_t source = edges[first].source;
+		shapeSource = source;
+		shapePoints.clear();
+		for(; chainContinues[i]; ++i) {
+			shapePoints.push_back(state->nodeCoordinates[edges[i].target]);
+			edges[first].weight += edges[i+1].weight;
+		}
+		if (i != first) {
+			edges[i].weight = edges[first].weight;
+			edges[i].source = source;
+		}
+		Edge & e = edges[i];
+		e.source = state->writtenNodeIds.at(e.source);
+		e.target = state->writtenNodeIds.at(e.target);
+	}
+	///Counts edges[i] and its reverse edge in the shapeWriter and writes the shape of the last contracted chain if it is edges[i]
+	void writeShape(std::size_t i) {
+		const Edge & e = edges[i];
+		uint32_t rank = shapeWriter->countEdge(e.source, e.target);
+		uint32_t reverseRank = writeReverse[i] ? shapeWriter->countEdge(e.target, e.source) : ShapeFileWriter::NoEdge;
+		if (shapePoints.size()) {
+			shapeWriter->writeShape(e.source, e.target, rank, reverseRank, state->nodeCoordinates[shapeSource], shapePoints.data(), shapePoints.size());
+		}
+	}
 };
 
 }}}//end namespace
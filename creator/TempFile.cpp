@@ -0,0 +1,34 @@
+#include "TempFile.h"
+#include <stdexcept>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+int createUnlinkedTempFile(const std::string & directory, const std::string & prefix) {
+	std::string fileName = directory + "/" + prefix + "-XXXXXX";
+	std::vector<char> tmp(fileName.begin(), fileName.end());
+	tmp.push_back(0);
+	int fd = ::mkstemp(tmp.data());
+	if (fd < 0) {
+		throw std::runtime_error("Could not create temporary file in " + directory);
+	}
+	//the file is removed as soon as it is closed
+	::unlink(tmp.data());
+	return fd;
+}
+
+FILE * openUnlinkedTempFile(const std::string & directory, const std::string & prefix) {
+	int fd = createUnlinkedTempFile(directory, prefix);
+	FILE * file = ::fdopen(fd, "w+b");
+	if (!file) {
+		::close(fd);
+		throw std::runtime_error("Could not open temporary file in " + directory);
+	}
+	return file;
+}
+
+}}}//end namespace
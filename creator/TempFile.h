@@ -0,0 +1,20 @@
+#ifndef OSM_GRAPH_TOOLS_TEMP_FILE_H
+#define OSM_GRAPH_TOOLS_TEMP_FILE_H
+#include <cstdio>
+#include <string>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+///Creates a temporary file directory/prefix-XXXXXX that is removed as soon as it is closed
+///@return the file descriptor of the file opened for reading and writing
+///@throws std::runtime_error if the file could not be created
+int createUnlinkedTempFile(const std::string & directory, const std::string & prefix);
+
+///Same as createUnlinkedTempFile but opens the file as a binary stdio stream
+FILE * openUnlinkedTempFile(const std::string & directory, const std::string & prefix);
+
+}}}//end namespace
+
+#endif
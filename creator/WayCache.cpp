@@ -0,0 +1,156 @@
+#include "WayCache.h"
+#include "TempFile.h"
+#include <stdexcept>
+#include <cstring>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+namespace {
+
+constexpr std::size_t WayCacheBufferSize = 16*1024*1024;
+
+} //end namespace
+
+constexpr uint8_t WayCache::HasMaxSpeed;
+
+WayCache::WayCache() {}
+
+WayCache::~WayCache() {
+	if (m_file) {
+		::fclose(m_file);
+	}
+}
+
+void WayCache::create(const std::string & directory) {
+	m_file = openUnlinkedTempFile(directory, "osmgraphcreator-waycache");
+	m_finished = false;
+	m_dataSize = 0;
+	m_wayCount = 0;
+	m_prevId = 0;
+	m_buffer.reserve(WayCacheBufferSize);
+}
+
+void WayCache::putRecord() {
+	if (m_buffer.size() + m_record.size() + 10 > WayCacheBufferSize) {
+		if (::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size()) {
+			throw std::runtime_error("Could not write to way cache");
+		}
+		m_buffer.clear();
+	}
+	std::size_t sizeBefore = m_buffer.size();
+	putVarUInt(m_buffer, m_record.size());
+	m_buffer.insert(m_buffer.end(), m_record.begin(), m_record.end());
+	m_dataSize += m_buffer.size() - sizeBefore;
+	m_wayCount += 1;
+}
+
+void WayCache::finish() {
+	assert(writable());
+	if (m_buffer.size() && ::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file) != m_buffer.size()) {
+		throw std::runtime_error("Could not write to way cache");
+	}
+	if (::fflush(m_file) != 0) {
+		throw std::runtime_error("Could not write to way cache");
+	}
+	m_buffer = std::vector<uint8_t>();
+	m_record = std::vector<uint8_t>();
+	m_finished = true;
+	std::cout << "Way cache holds " << m_wayCount << " ways in " << m_dataSize/(1024*1024) << " MiB" << std::endl;
+}
+
+WayCache::Reader::Reader(WayCache & cache) :
+m_cache(cache),
+m_buffer(WayCacheBufferSize)
+{
+	if (::fseek(m_cache.m_file, 0, SEEK_SET) != 0) {
+		throw std::runtime_error("Could not seek in way cache");
+	}
+}
+
+bool WayCache::Reader::fill(std::size_t minSize) {
+	if (m_bufferEnd - m_bufferPos >= minSize) {
+		return true;
+	}
+	if (minSize > m_buffer.size()) {
+		m_buffer.resize(minSize);
+	}
+	::memmove(m_buffer.data(), m_buffer.data()+m_bufferPos, m_bufferEnd - m_bufferPos);
+	m_bufferEnd -= m_bufferPos;
+	m_bufferPos = 0;
+	uint64_t remaining = m_cache.m_dataSize - m_filePos;
+	std::size_t toRead = std::min<uint64_t>(m_buffer.size() - m_bufferEnd, remaining);
+	if (toRead && ::fread(m_buffer.data()+m_bufferEnd, 1, toRead, m_cache.m_file) != toRead) {
+		throw std::runtime_error("Could not read from way cache");
+	}
+	m_bufferEnd += toRead;
+	m_filePos += toRead;
+	return m_bufferEnd - m_bufferPos >= minSize;
+}
+
+bool WayCache::Reader::next() {
+	//a record size needs at most 10 bytes
+	if (!fill(10) && m_bufferPos == m_bufferEnd) {
+		return false;
+	}
+	const uint8_t * it = m_buffer.data()+m_bufferPos;
+	uint64_t recordSize;
+	if (!getVarUInt(it, m_buffer.data()+m_bufferEnd, recordSize)) {
+		throw std::runtime_error("Way cache is corrupt");
+	}
+	m_bufferPos = it - m_buffer.data();
+	if (!fill(recordSize)) {
+		throw std::runtime_error("Way cache is corrupt");
+	}
+	it = m_buffer.data()+m_bufferPos;
+	const uint8_t * end = it + recordSize;
+
+	int64_t idDelta, hwType;
+	int64_t maxSpeed = 0;
+	uint64_t refCount;
+	bool hasMaxSpeed = false;
+	bool ok = getVarSInt(it, end, idDelta) && getVarSInt(it, end, hwType) && it != end;
+	if (ok) {
+		m_ows = *it & ~HasMaxSpeed;
+		hasMaxSpeed = *it & HasMaxSpeed;
+		++it;
+		ok = (!hasMaxSpeed || getVarSInt(it, end, maxSpeed)) && getVarUInt(it, end, refCount);
+	}
+	if (ok) {
+		m_refs.resize(refCount);
+		int64_t prevRef = 0;
+		for(uint64_t i(0); ok && i < refCount; ++i) {
+			int64_t delta;
+			ok = getVarSInt(it, end, delta);
+			prevRef += delta;
+			m_refs[i] = prevRef;
+		}
+	}
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	uint64_t tagsSize;
+	if (ok && getVarUInt(it, end, tagsSize) && tagsSize <= uint64_t(end - it)) {
+		m_tags.assign((const char*) it, tagsSize);
+		it += tagsSize;
+	}
+	else {
+		ok = false;
+	}
+	#endif
+	if (!ok) {
+		throw std::runtime_error("Way cache is corrupt");
+	}
+	m_bufferPos += recordSize;
+
+	m_prevId += idDelta;
+	m_hwType = hwType;
+	static_cast<ParsedWay&>(m_way) = ParsedWay(m_prevId, m_refs.data(), m_refs.data()+m_refs.size());
+	m_way.m_hasMaxSpeed = hasMaxSpeed;
+	m_way.m_maxSpeed = int(maxSpeed);
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	m_way.setTags(&m_tags);
+	#endif
+	return true;
+}
+
+}}}//end namespace
@@ -0,0 +1,182 @@
+#ifndef OSM_GRAPH_TOOLS_WAY_CACHE_H
+#define OSM_GRAPH_TOOLS_WAY_CACHE_H
+#include "Processors.h"
+#include "Encoding.h"
+#include <cstdio>
+
+namespace osm {
+namespace graphtools {
+namespace creator {
+
+///A way read from the WayCache. The maxspeed tag is already parsed.
+class CachedWay: public ParsedWay {
+public:
+	CachedWay() : ParsedWay(0, 0, 0) {}
+	inline bool hasMaxSpeed() const { return m_hasMaxSpeed; }
+	inline int maxSpeed() const { return m_maxSpeed; }
+private:
+	friend class WayCache;
+	bool m_hasMaxSpeed{false};
+	int m_maxSpeed{0};
+};
+
+inline bool wayMaxSpeed(const StoredTags & /*storedKv*/, const CachedWay & way, int & maxSpeed) {
+	maxSpeed = way.maxSpeed();
+	return way.hasMaxSpeed();
+}
+
+/**
+ * Stores all ways accepted by WayParser in a compact temporary file.
+ * Later passes stream the ways from this file instead of decoding the input file again.
+ *
+ * Every way is stored as a record:
+ * varuint   recordSize (size of the following data)
+ * varsint   id delta to the previous way
+ * varsint   hwType
+ * uint8     OneWayStatus, HasMaxSpeed is set if the way has a valid maxspeed tag
+ * [varsint  maxspeed] if HasMaxSpeed is set
+ * varuint   refCount
+ * varsint[] ref deltas, the first ref is relative to 0
+ * [varuint  tags size, char[] tags] with CONFIG_CREATOR_COPY_TAGS
+ *
+ * The file is unlinked directly after creation and is removed by the system as soon as the cache is destroyed.
+ */
+class WayCache {
+public:
+	static constexpr uint8_t HasMaxSpeed = 0x80;
+public:
+	///Reads the ways from the cache
+	class Reader {
+	public:
+		Reader(WayCache & cache);
+		bool next();
+		inline int ows() const { return m_ows; }
+		inline int hwType() const { return m_hwType; }
+		inline const CachedWay & way() const { return m_way; }
+		///position in bytes
+		inline uint64_t position() const { return m_filePos - (m_bufferEnd - m_bufferPos); }
+	private:
+		bool fill(std::size_t minSize);
+	private:
+		WayCache & m_cache;
+		std::vector<uint8_t> m_buffer;
+		std::size_t m_bufferPos{0};
+		std::size_t m_bufferEnd{0};
+		uint64_t m_filePos{0};
+		int64_t m_prevId{0};
+		int m_ows{OW_IMPLICIT};
+		int m_hwType{0};
+		std::vector<int64_t> m_refs;
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		std::string m_tags;
+		#endif
+		CachedWay m_way;
+	};
+public:
+	WayCache();
+	WayCache(const WayCache &) = delete;
+	WayCache & operator=(const WayCache &) = delete;
+	~WayCache();
+	///create the cache file in directory
+	void create(const std::string & directory);
+	///the cache was created, but not finished yet
+	inline bool writable() const { return m_file && !m_finished; }
+	///all ways were added
+	inline bool valid() const { return m_file && m_finished; }
+	///size of the cache in bytes
+	inline uint64_t dataSize() const { return m_dataSize; }
+	inline uint64_t wayCount() const { return m_wayCount; }
+	template<typename TRefIterator>
+	void add(int64_t id, int ows, int hwType, bool hasMaxSpeed, int maxSpeed, TRefIterator refBegin, TRefIterator refEnd, const std::string & tags);
+	void finish();
+
+	///Same as WayParser::parse, but reads the ways from the cache. The result of progressStatus is shown with the progress if set
+	template<typename TOPERATOR>
+	void parse(const std::string & message, TOPERATOR & processor, const std::function<std::string()> & progressStatus = std::function<std::string()>());
+private:
+	void putRecord();
+private:
+	FILE * m_file{0};
+	bool m_finished{false};
+	uint64_t m_dataSize{0};
+	uint64_t m_wayCount{0};
+	int64_t m_prevId{0};
+	std::vector<uint8_t> m_record;
+	std::vector<uint8_t> m_buffer;
+};
+
+///Adds all ways to a WayCache, use this in the first pass over the ways
+struct WayCacheWriter {
+	WayCacheWriter(WayCache & cache) :
+	cache(cache)
+	{
+		kS.insert("maxspeed");
+	}
+	WayCache & cache;
+
+	std::unordered_set<std::string> kS;
+	inline const std::unordered_set<std::string> & keysToStore() const { return kS; }
+
+	template<typename TWay>
+	inline void operator()(int ows, int hwType, const StoredTags & storedKv, const TWay & way) {
+		int maxSpeed = 0;
+		bool hasMaxSpeed = wayMaxSpeed(storedKv, way, maxSpeed);
+		#ifdef CONFIG_CREATOR_COPY_TAGS
+		std::string tags = tags2json(way);
+		#else
+		std::string tags;
+		#endif
+		cache.add(way.id(), ows, hwType, hasMaxSpeed, maxSpeed, way.refBegin(), way.refEnd(), tags);
+	}
+};
+
+template<typename TRefIterator>
+void WayCache::add(int64_t id, int ows, int hwType, bool hasMaxSpeed, int maxSpeed, TRefIterator refBegin, TRefIterator refEnd, const std::string & tags) {
+	assert(writable());
+	m_record.clear();
+	putVarSInt(m_record, id - m_prevId);
+	putVarSInt(m_record, hwType);
+	m_record.push_back(uint8_t(ows) | (hasMaxSpeed ? HasMaxSpeed : 0));
+	if (hasMaxSpeed) {
+		putVarSInt(m_record, maxSpeed);
+	}
+	uint64_t refCount = 0;
+	for(TRefIterator it(refBegin); it != refEnd; ++it) {
+		++refCount;
+	}
+	putVarUInt(m_record, refCount);
+	int64_t prevRef = 0;
+	for(TRefIterator it(refBegin); it != refEnd; ++it) {
+		int64_t ref = *it;
+		putVarSInt(m_record, ref - prevRef);
+		prevRef = ref;
+	}
+	#ifdef CONFIG_CREATOR_COPY_TAGS
+	putVarUInt(m_record, tags.size());
+	m_record.insert(m_record.end(), tags.begin(), tags.end());
+	#else
+	(void) tags;
+	#endif
+	m_prevId = id;
+	putRecord();
+}
+
+template<typename TOPERATOR>
+void WayCache::parse(const std::string & message, TOPERATOR & processor, const std::function<std::string()> & progressStatus) {
+	assert(valid());
+	const StoredTags storedKv;
+	Reader reader(*this);
+	sserialize::ProgressInfo progress;
+	progress.begin(dataSize(), message);
+	for(uint64_t i(0); reader.next(); ++i) {
+		processor(reader.ows(), reader.hwType(), storedKv, reader.way());
+		if (i % 4096 == 0) {
+			updateProgress(progress, reader.position(), progressStatus);
+		}
+	}
+	progress.end();
+}
+
+}}}//end namespace
+
+#endif
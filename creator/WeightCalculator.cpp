@@ -1,42 +1,114 @@
 #include "WeightCalculator.h"
+#include <cmath>
+
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+	#define CREATOR_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+	#define CREATOR_TARGET_CLONES
+#endif
 
 namespace osm {
 namespace graphtools {
 namespace creator {
+namespace detail {
+namespace WeightCalculator {
+
+///cos(x) for |x| <= pi/2 using the Taylor series up to x^20, the truncation error is below 2e-17.
+///Unlike std::cos this is vectorized by the compiler.
+inline double cosHalfPi(double x) {
+	//(-1)^k/(2k)!
+	constexpr double c[] = {
+		1.0, -1.0/2, 1.0/24, -1.0/720, 1.0/40320, -1.0/3628800, 1.0/479001600,
+		-1.0/87178291200.0, 1.0/20922789888000.0, -1.0/6402373705728000.0, 1.0/2432902008176640000.0
+	};
+	double x2 = x*x;
+	double r = c[10];
+	for(int k = 9; k >= 0; --k) {
+		r = r*x2 + c[k];
+	}
+	return r;
+}
+
+/**
+ * Approximates the WGS84 geodesic distance in meters between (lat0[i], lon0[i]) and (lat1[i], lon1[i]).
+ * The ellipsoid is approximated locally at the mean latitude by a plane using the meridional and the prime vertical radius.
+ * The error grows quadratically with the difference in latitude and longitude.
+ * Compared to the geodesic distance the relative error is below 1e-7 if both differ by at most 0.01 degrees,
+ * it reaches 1e-3 for distances of 100 km.
+ */
+CREATOR_TARGET_CLONES
+void fastEllipsoidalDistances(const double * __restrict lat0, const double * __restrict lon0, const double * __restrict lat1, const double * __restrict lon1, double * __restrict dest, std::size_t count) {
+	constexpr double a = 6378137.0;
+	constexpr double f = 1/298.257223563;
+	constexpr double e2 = f*(2-f);
+	constexpr double deg2rad = M_PI/180;
+	for(std::size_t i = 0; i < count; ++i) {
+		double dLat = (lat1[i] - lat0[i])*deg2rad;
+		double dLon = lon1[i] - lon0[i];
+		dLon = (dLon - 360*double(int(dLon > 180) - int(dLon < -180)))*deg2rad; //without branches to allow vectorization
+		double cosLat = cosHalfPi((lat0[i] + lat1[i])*(deg2rad/2));
+		double w2 = 1 - e2*(1 - cosLat*cosLat);
+		double w = std::sqrt(w2);
+		double meridionalRadius = a*(1-e2)/(w2*w);
+		double primeVerticalRadius = a/w;
+		double dy = meridionalRadius*dLat;
+		double dx = primeVerticalRadius*cosLat*dLon;
+		dest[i] = std::sqrt(dx*dx + dy*dy);
+	}
+}
+
+}}//end namespace detail::WeightCalculator
 
 inline double kmh_to_ms(double kmh) {
 	return kmh*3.6;
 }
 
-int NoWeightCalculator::calc(const osm::graphtools::creator::Edge & /*edge*/) {
-	return 1;
+double EdgeLengthCalculator::calc(const Edge & edge) {
+	Coordinates src = state->nodeCoordinates[edge.source];
+	Coordinates dest = state->nodeCoordinates[edge.target];
+	double length = distCalc.calc(src.lat, src.lon, dest.lat, dest.lon);
+	assert(length >= 0.0);
+	return length;
 }
 
-int GeodesicDistanceWeightCalculator::calc(const osm::graphtools::creator::Edge & edge) {
-	double length;
-	const Coordinates & src = state->nodeCoordinates[edge.source];
-	const Coordinates & dest = state->nodeCoordinates[edge.target];
-	length = distCalc.calc(src.lat, src.lon, dest.lat, dest.lon);
-	assert(length >= 0.0);
-	return length*state->cmd.distanceMult;
+void EdgeLengthCalculator::calc(const Edge * begin, const Edge * end, std::vector<double> & lengths) {
+	std::size_t count = end - begin;
+	lengths.resize(count);
+	if (!state->cmd.fastDistance) {
+		for(std::size_t i(0); i < count; ++i) {
+			lengths[i] = calc(begin[i]);
+		}
+		return;
+	}
+	m_lat0.resize(count);
+	m_lon0.resize(count);
+	m_lat1.resize(count);
+	m_lon1.resize(count);
+	for(std::size_t i(0); i < count; ++i) {
+		Coordinates src = state->nodeCoordinates[begin[i].source];
+		Coordinates dest = state->nodeCoordinates[begin[i].target];
+		m_lat0[i] = src.lat;
+		m_lon0[i] = src.lon;
+		m_lat1[i] = dest.lat;
+		m_lon1[i] = dest.lon;
+	}
+	detail::WeightCalculator::fastEllipsoidalDistances(m_lat0.data(), m_lon0.data(), m_lat1.data(), m_lon1.data(), lengths.data(), count);
+	//the approximation is only accurate for short edges
+	for(std::size_t i(0); i < count; ++i) {
+		if (std::abs(m_lat1[i] - m_lat0[i]) > FastDistanceMaxDelta || std::abs(m_lon1[i] - m_lon0[i]) > FastDistanceMaxDelta) {
+			lengths[i] = calc(begin[i]);
+		}
+	}
 }
 
-int WeightedGeodesicDistanceWeightCalculator::calc(const osm::graphtools::creator::Edge & edge) {
-	double length;
-	const Coordinates & src = state->nodeCoordinates[edge.source];
-	const Coordinates & dest = state->nodeCoordinates[edge.target];
-	length = distCalc.calc(src.lat, src.lon, dest.lat, dest.lon);
-	assert(length >= 0.0);
-	return state->cmd.timeMult/100*length*state->cfg.typeToWeight.at(edge.type);
-};
-
-int MaxSpeedGeodesicDistanceWeightCalculator::calc(const Edge & edge) {
-	double length;
-	const Coordinates & src = state->nodeCoordinates[edge.source];
-	const Coordinates & dest = state->nodeCoordinates[edge.target];
-	length = distCalc.calc(src.lat, src.lon, dest.lat, dest.lon);
-	assert(length >= 0.0);
-	return state->cmd.timeMult/100*length*3600/edge.maxspeed;
+int NoWeightCalculator::calc(const osm::graphtools::creator::Edge & /*edge*/) {
+	return 1;
+}
+
+void NoWeightCalculator::calc(Edge * begin, Edge * end) {
+	for(Edge * it(begin); it != end; ++it) {
+		it->weight = 1;
+	}
 }
 
 
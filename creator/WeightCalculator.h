@@ -1,6 +1,7 @@
 #ifndef OSM_GRAPH_TOOLS_WEIGHT_CALCULATOR_H
 #define OSM_GRAPH_TOOLS_WEIGHT_CALCULATOR_H
 #include <unordered_map>
+#include <vector>
 #include <sserialize/spatial/DistanceCalculator.h>
 #include "types.h"
 
@@ -11,40 +12,91 @@ namespace creator {
 struct WeightCalculator {
 	virtual ~WeightCalculator() {}
 	virtual int calc(const Edge & edge) = 0;
+	///Sets the weight of all edges in [begin, end)
+	virtual void calc(Edge * begin, Edge * end) = 0;
+};
+
+///Calculates the length of edges in meters using the coordinates in state->nodeCoordinates.
+///If state->cmd.fastDistance is set then edges whose latitude and longitude differ by at most FastDistanceMaxDelta degrees
+///are calculated in batches by a vectorized local ellipsoidal approximation of the WGS84 geodesic distance.
+///Its relative error compared to sserialize::spatial::detail::GeodesicDistanceCalculator is below 1e-7,
+///i.e. less than 0.2 mm for the longest edges it is used for.
+struct EdgeLengthCalculator {
+	static constexpr double FastDistanceMaxDelta = 0.01;
+	EdgeLengthCalculator(StatePtr state) : state(state) {}
+	StatePtr state;
+	sserialize::spatial::detail::GeodesicDistanceCalculator distCalc;
+	
+	double calc(const Edge & edge);
+	///Sets lengths[i] to the length of begin[i]
+	void calc(const Edge * begin, const Edge * end, std::vector<double> & lengths);
+private:
+	std::vector<double> m_lat0;
+	std::vector<double> m_lon0;
+	std::vector<double> m_lat1;
+	std::vector<double> m_lon1;
 };
 
 struct NoWeightCalculator: public WeightCalculator {
 	~NoWeightCalculator() override {}
 	int calc(const Edge & edges) override;
+	void calc(Edge * begin, Edge * end) override;
 };
 
-struct GeodesicDistanceWeightCalculator: public WeightCalculator {
-	GeodesicDistanceWeightCalculator(StatePtr state) : state(state)  {}
-	~GeodesicDistanceWeightCalculator() override {}
-	StatePtr state;
-	sserialize::spatial::detail::GeodesicDistanceCalculator distCalc;
-	
-	int calc(const Edge & edge) override;
+///Weight of an edge given its length in meters, used by GeodesicWeightCalculator
+struct DistanceWeight {
+	DistanceWeight(const State & state) : distanceMult(state.cmd.distanceMult) {}
+	double distanceMult;
+	inline int operator()(const Edge & /*edge*/, double length) const {
+		return length*distanceMult;
+	}
 };
 
-struct WeightedGeodesicDistanceWeightCalculator: public WeightCalculator {
-	WeightedGeodesicDistanceWeightCalculator(StatePtr state) : state(state)  {}
-	~WeightedGeodesicDistanceWeightCalculator() override {}
-	StatePtr state;
-	sserialize::spatial::detail::GeodesicDistanceCalculator distCalc;
-	std::shared_ptr< std::unordered_map<int, double> > typeToWeight;
-	
-	int calc(const Edge & edge) override;
+///Travel time based on the edge type
+struct TravelTimeWeight {
+	TravelTimeWeight(const State & state) : timeFactor(state.cmd.timeMult/100), typeWeights(state.cfg.typeWeights) {}
+	double timeFactor;
+	std::vector<double> typeWeights;
+	inline int operator()(const Edge & edge, double length) const {
+		return timeFactor*length*typeWeights[edge.type];
+	}
+};
+
+///Travel time in seconds based on the maxspeed of the edge
+struct MaxSpeedTravelTimeWeight {
+	MaxSpeedTravelTimeWeight(const State & state) : timeFactor(state.cmd.timeMult/100) {}
+	double timeFactor;
+	inline int operator()(const Edge & edge, double length) const {
+		return timeFactor*length*3600/edge.maxspeed;
+	}
 };
 
-struct MaxSpeedGeodesicDistanceWeightCalculator: public WeightCalculator {
-	MaxSpeedGeodesicDistanceWeightCalculator(StatePtr state) : state(state) {}
-	~MaxSpeedGeodesicDistanceWeightCalculator() override {}
+///Calculates the weight of edges from their length with TWeight.
+///The calculator is selected once, the weights of a batch of edges are then calculated without further virtual calls
+template<typename TWeight>
+struct GeodesicWeightCalculator: public WeightCalculator {
+	GeodesicWeightCalculator(StatePtr state) : state(state), lengthCalc(state), weight(*state) {}
+	~GeodesicWeightCalculator() override {}
 	StatePtr state;
-	sserialize::spatial::detail::GeodesicDistanceCalculator distCalc;
-	///Calulate travel time in seconds
-	int calc(const Edge & edge) override;
+	EdgeLengthCalculator lengthCalc;
+	TWeight weight;
+	
+	int calc(const Edge & edge) override {
+		return weight(edge, lengthCalc.calc(edge));
+	}
+	void calc(Edge * begin, Edge * end) override {
+		lengthCalc.calc(begin, end, m_lengths);
+		for(std::size_t i(0), s(end-begin); i < s; ++i) {
+			begin[i].weight = weight(begin[i], m_lengths[i]);
+		}
+	}
+private:
+	std::vector<double> m_lengths;
 };
 
+typedef GeodesicWeightCalculator<DistanceWeight> GeodesicDistanceWeightCalculator;
+typedef GeodesicWeightCalculator<TravelTimeWeight> WeightedGeodesicDistanceWeightCalculator;
+typedef GeodesicWeightCalculator<MaxSpeedTravelTimeWeight> MaxSpeedGeodesicDistanceWeightCalculator;
+
 }}}//end namespace
 #endif
@@ -1,8 +1,15 @@
 #include <iostream>
 #include <fstream>
 #include <limits>
+#include <cstdlib>
 #include "Processors.h"
+#include "WayCache.h"
 #include "RamGraph.h"
+#include "AsyncOutputStream.h"
+#include "GzipOutputStream.h"
+#include "ComponentContainer.h"
+#include "NodeOrder.h"
+#include "Partitioner.h"
 
 using namespace osm::graphtools::creator;
 
@@ -42,6 +49,10 @@ bool readConfig(const std::string & fileName, State::Configuration & cfg) {
 			return false;
 		}
 		int id = atoi(typeId.c_str());
+		if (id < 0 || id > State::Configuration::MaxTypeId) {
+			std::cout << "Invalid typeId in config: " << typeId << std::endl;
+			return false;
+		}
 		cfg.hwTagIds[value] = id;
 		cfg.typeToWeight[id] = 360.0 / atof(weight.c_str()); // 100 / ( (w*1000)/3600 )
 	}
@@ -63,11 +74,33 @@ void help() {
 	"\tmaxspeed calculates travel time based on maxspeed tag and edge type in [s/<-tm>]\n"
 	"-c path to to config (see sample configs) \n"
 	"-s sort edges according to source and target \n"
+	"--sort-memory NUM sort edges with at most NUM MiB of memory, edges are sorted externally if they need more. Default 4096\n"
+	"--place-edges (target|source) like -s, but places every edge directly at its position given by the node degrees. Needs an additional pass over the ways\n"
+	"\ttarget sorts edges with the same source by target, source keeps them in the order of the ways\n"
+	"--contract-chains replace chains of nodes with degree 2 by a single edge, their coordinates are written to <outfile>.shape\n"
+	"--reorder (hilbert|morton) number the nodes along a space filling curve through their coordinates for better cache locality\n"
+	"--partition NUM partition the graph into cells of at most 2^NUM nodes by recursive bisection using the threads given by -j.\n"
+	"\tThe cell of every node is written to <outfile>.cells\n"
+	"--partition-order with --partition number the nodes by cell, the nodes of a cell get consecutive ids\n"
 	"-cc <mode> <threshold> split graph into connected components. Possible modes: topk, size, all\n"
-	"-hs NUM use a direct hashing scheme with NUM entries for the osmid->nodeid hash. Set to auto for auto-size.\n"
+	"\tscc-topk, scc-size and scc-all split the directed graph into strongly connected components instead\n"
+	"--cc-container write all connected components into the single file <outfile>.cc with an index at its end\n"
+	"-hs NUM use a direct hashing scheme with NUM entries for the osmid->nodeid hash.\n"
+	"\tSet to auto to use a rank/select bit vector over all node ids if this needs less memory than a hash map.\n"
+	"\tNode ids are then ordered by osm id, which is the same as the input order for inputs sorted by id.\n"
 	"-b \"minlat maxlat minlon maxlon\" \n"
 	"-dm specifies the distance multiplier. For 1000 the distance is in mm. Default 1\n"
 	"-tm specifies the time multiplier. For 1000 the time is in ms. Default 100\n"
+	"-j NUM decode and match blocks with NUM threads. Output is the same as with a single thread. Default 1\n"
+	"--way-cache DIR store the way cache and the sorted runs of -s in DIR instead of TMPDIR\n"
+	"--no-way-cache decode the input file in every pass over the ways instead of using a way cache\n"
+	"--fast-distance approximate the length of short edges in batches. The relative error is below 1e-7\n"
+	"--single-node-pass read the nodes only once. Nodes of invalid ways are kept in memory until all ways are checked\n"
+	"--async-output write the output in a dedicated thread. The progress of the final pass shows the number of queued output buffers\n"
+	"--gzip (NUM|default) compress the output of stream based formats with gzip level NUM using the threads given by -j. Not supported by sserialize graph types.\n"
+	"\tFiles of connected components get the suffix .gz\n"
+	"--coordinate-precision (NUM|shortest) write coordinates of text formats with NUM decimal digits. 7 is the precision of osm data.\n"
+	"\tshortest writes the least number of digits that read back to the same value. Default 17\n"
 	"--no-reverse-edge" << std::endl;
 }
 
@@ -117,6 +150,11 @@ int main(int argc, char ** argv) {
 		else if (token == "-cc" && i+1 < argc) {
 			state->cmd.connectedComponents = true;
 			token = std::string(argv[i+1]);
+			//the scc- modes select strongly connected components
+			if (token.compare(0, 4, "scc-") == 0) {
+				state->cmd.cc_strong = true;
+				token = token.substr(4);
+			}
 			if (token == "topk") {
 				state->cmd.cc_filter_mode = FilterMode::TopK;
 			}
@@ -140,6 +178,9 @@ int main(int argc, char ** argv) {
 				++i;
 			}
 		}
+		else if (token == "--cc-container") {
+			state->cmd.ccContainer = true;
+		}
 		else if (token == "-c" && i+1 < argc) {
 			configFileName = std::string(argv[i+1]);
 			++i;
@@ -209,6 +250,17 @@ int main(int argc, char ** argv) {
 			state->cmd.timeMult = atof(argv[i+1]);
 			++i;
 		}
+		else if (token == "-j" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			try {
+				state->cmd.threadCount = std::max<int>(std::stoi(v), 1);
+			}
+			catch (std::invalid_argument const & e) {
+				std::cerr << "Option to -j needs to be an integer value. Got: " << v << std::endl;
+				return -1;
+			}
+			++i;
+		}
 		else if (token == "-b" && i+1 < argc) {
 			std::string v(argv[i+1]);
 			state->cmd.bounds = sserialize::spatial::GeoRect(v);
@@ -221,6 +273,121 @@ int main(int argc, char ** argv) {
 			}
 			++i;
 		}
+		else if (token == "--place-edges" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			if (v == "target") {
+				state->cmd.placeEdgesSortTargets = true;
+			}
+			else if (v == "source") {
+				state->cmd.placeEdgesSortTargets = false;
+			}
+			else {
+				std::cerr << "Invalid mode for --place-edges: " << v << std::endl;
+				return -1;
+			}
+			state->cmd.sortedEdges = true;
+			state->cmd.placeEdges = true;
+			++i;
+		}
+		else if (token == "--sort-memory" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			try {
+				state->cmd.sortMemory = uint64_t(std::max<long>(std::stol(v), 1)) << 20;
+			}
+			catch (std::logic_error const & e) {
+				std::cerr << "Option to --sort-memory needs to be an integer value. Got: " << v << std::endl;
+				return -1;
+			}
+			++i;
+		}
+		else if (token == "--way-cache" && i+1 < argc) {
+			state->cmd.wayCacheDirectory = std::string(argv[i+1]);
+			++i;
+		}
+		else if (token == "--no-way-cache") {
+			state->cmd.wayCache = false;
+		}
+		else if (token == "--fast-distance") {
+			state->cmd.fastDistance = true;
+		}
+		else if (token == "--contract-chains") {
+			state->cmd.contractChains = true;
+		}
+		else if (token == "--reorder" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			if (v == "hilbert") {
+				state->cmd.nodeOrder = NO_HILBERT;
+			}
+			else if (v == "morton") {
+				state->cmd.nodeOrder = NO_MORTON;
+			}
+			else {
+				std::cerr << "Invalid order for --reorder: " << v << std::endl;
+				return -1;
+			}
+			++i;
+		}
+		else if (token == "--partition" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			try {
+				state->cmd.partitionCellBits = std::stoi(v);
+			}
+			catch (std::logic_error const & e) {
+				state->cmd.partitionCellBits = -1;
+			}
+			if (state->cmd.partitionCellBits < 0 || state->cmd.partitionCellBits > 31) {
+				std::cerr << "Option to --partition needs to be an integer value in [0, 31]. Got: " << v << std::endl;
+				return -1;
+			}
+			++i;
+		}
+		else if (token == "--partition-order") {
+			state->cmd.partitionOrder = true;
+		}
+		else if (token == "--async-output") {
+			state->cmd.asyncOutput = true;
+		}
+		else if (token == "--gzip" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			if (v == "default") {
+				state->cmd.gzipLevel = -1;
+			}
+			else {
+				try {
+					state->cmd.gzipLevel = std::stoi(v);
+				}
+				catch (std::logic_error const & e) {
+					state->cmd.gzipLevel = -2;
+				}
+				if (state->cmd.gzipLevel < 0 || state->cmd.gzipLevel > 9) {
+					std::cerr << "Option to --gzip needs to be default or an integer in [0, 9]. Got: " << v << std::endl;
+					return -1;
+				}
+			}
+			++i;
+		}
+		else if (token == "--coordinate-precision" && i+1 < argc) {
+			std::string v(argv[i+1]);
+			if (v == "shortest") {
+				state->cmd.coordinatePrecision = OutputBuffer::ShortestPrecision;
+			}
+			else {
+				try {
+					state->cmd.coordinatePrecision = std::stoi(v);
+				}
+				catch (std::logic_error const & e) {
+					state->cmd.coordinatePrecision = -1;
+				}
+				if (state->cmd.coordinatePrecision < 0 || state->cmd.coordinatePrecision > 30) {
+					std::cerr << "Option to --coordinate-precision needs to be shortest or an integer in [0, 30]. Got: " << v << std::endl;
+					return -1;
+				}
+			}
+			++i;
+		}
+		else if (token == "--single-node-pass") {
+			state->cmd.singleNodePass = true;
+		}
 		else if (token == "--no-reverse-edge") {
 			state->cmd.addReverseEdges = false;
 		}
@@ -256,20 +423,46 @@ int main(int argc, char ** argv) {
 	if (state->cfg.hwTagIds.count("motorway_link")) {
 		state->cfg.implicitOneWay.insert(state->cfg.hwTagIds.at("motorway_link"));
 	}
+	state->cfg.buildTypeTables();
 	
-	auto graphWriterFactory = [&](std::string const & outFileName) {
+	std::string tempDirectory = state->cmd.wayCacheDirectory;
+	if (tempDirectory.empty()) {
+		tempDirectory = (std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp");
+	}
+	
+	std::weak_ptr<AsyncOutputStream> asyncOutput; //output stream of the last created writer if it is asynchronous
+	std::shared_ptr<PlacedEdgeWriter> placedEdgeWriter; //placement of the edges, needs the edge offsets before the edges are written
+	//opens outFileName, asynchronous if requested
+	auto openOutFile = [&](std::string const & outFileName) {
+		std::shared_ptr<std::ostream> outFile;
+		auto fileStream = std::make_shared<std::ofstream>(outFileName);
+		if (!fileStream->is_open()) {
+			throw std::runtime_error("Failed to open out file " + outFileName);
+		}
+		outFile = fileStream;
+		if (state->cmd.asyncOutput && state->cmd.graphType != GT_NONE) {
+			auto asyncStream = std::make_shared<AsyncOutputStream>(outFile);
+			asyncOutput = asyncStream;
+			outFile = asyncStream;
+		}
+		return outFile;
+	};
+	//creates the graph writer for outFileName, if target is set the graph is written to target instead
+	auto graphWriterFactory = [&](std::string const & outFileName, std::shared_ptr<std::ostream> target = std::shared_ptr<std::ostream>()) {
 		std::shared_ptr< GraphWriter > graphWriter;
-		std::shared_ptr<std::ofstream> outFile;
+		std::shared_ptr<std::ostream> outFile = target;
 		if (state->cmd.graphType != GT_SSERIALIZE_OFFSET_ARRAY && state->cmd.graphType != GT_SSERIALIZE_LARGE_OFFSET_ARRAY) {
-			outFile = std::make_shared<std::ofstream>(outFileName);
-			if (!outFile->is_open()) {
-				throw std::runtime_error("Failed to open out file " + outFileName);
+			if (!outFile) {
+				outFile = openOutFile(outFileName);
+			}
+			//compression threads write to the async stream if both are enabled
+			if (state->cmd.gzipLevel >= -1 && state->cmd.graphType != GT_NONE) {
+				outFile = std::make_shared<GzipOutputStream>(outFile, state->cmd.threadCount, state->cmd.gzipLevel);
 			}
-			*outFile << std::fixed << std::setprecision(std::numeric_limits<double>::digits10 + 2);
 		}
 		switch (state->cmd.graphType) {
 		case GT_TOPO_TEXT:
-			graphWriter.reset(new TopologyTextGraphWriter(outFile));
+			graphWriter.reset(new TopologyTextGraphWriter(outFile, state->cmd.coordinatePrecision));
 			break;
 		case GT_TOPO_BINARY:
 			graphWriter.reset(new TopologyBinaryGraphWriter(outFile));
@@ -281,7 +474,7 @@ int main(int argc, char ** argv) {
 			graphWriter.reset(new FmiMaxSpeedBinaryGraphWriter(outFile));
 			break;
 		case GT_FMI_MAXSPEED_TEXT:
-			graphWriter.reset(new FmiMaxSpeedTextGraphWriter(outFile));
+			graphWriter.reset(new FmiMaxSpeedTextGraphWriter(outFile, state->cmd.coordinatePrecision));
 			break;
 		#ifdef CONFIG_SUPPORT_SSERIALIZE_OFFSET_ARRAY_TARGET
 		case GT_SSERIALIZE_OFFSET_ARRAY:
@@ -296,31 +489,64 @@ int main(int argc, char ** argv) {
 			throw std::runtime_error("Support for sserializeoffsetarray is disabled in build configuration");
 		#endif
 		case GT_PLOT:
-			graphWriter.reset( new PlotGraph(outFile) );
+			graphWriter.reset( new PlotGraph(outFile, state->cmd.coordinatePrecision) );
 			break;
 		case GT_FMI_TEXT:
-			graphWriter.reset(new FmiTextGraphWriter(outFile));
+			graphWriter.reset(new FmiTextGraphWriter(outFile, state->cmd.coordinatePrecision));
 			break;
 		case GT_NONE:
 			graphWriter.reset(new DropGraphWriter());
 		};
 		//connected components graph writer already sorts edges based on their source node
 		if (state->cmd.sortedEdges && !state->cmd.connectedComponents) {
-			graphWriter.reset(new SortedEdgeWriter(graphWriter));
+			if (state->cmd.placeEdges) {
+				placedEdgeWriter.reset(new PlacedEdgeWriter(graphWriter, state->cmd.placeEdgesSortTargets, tempDirectory));
+				graphWriter = placedEdgeWriter;
+			}
+			else {
+				graphWriter.reset(new SortedEdgeWriter(graphWriter, state->cmd.threadCount, state->cmd.sortMemory, tempDirectory));
+			}
 		}
 		return graphWriter;
 	};
 	
 	
 	std::shared_ptr< GraphWriter > graphWriter;
+	std::shared_ptr<ComponentContainerWriter> componentContainer;
+	if (state->cmd.gzipLevel >= -1 && (state->cmd.graphType == GT_SSERIALIZE_OFFSET_ARRAY || state->cmd.graphType == GT_SSERIALIZE_LARGE_OFFSET_ARRAY)) {
+		std::cerr << "--gzip is not supported by sserialize graph types" << std::endl;
+		return -1;
+	}
+	if (state->cmd.connectedComponents && state->cmd.ccContainer) {
+		if (state->cmd.graphType == GT_SSERIALIZE_OFFSET_ARRAY || state->cmd.graphType == GT_SSERIALIZE_LARGE_OFFSET_ARRAY) {
+			std::cerr << "--cc-container is not supported by sserialize graph types" << std::endl;
+			return -1;
+		}
+		try {
+			componentContainer.reset(new ComponentContainerWriter(
+				openOutFile(outFileName + ".cc"),
+				(state->cmd.gzipLevel >= -1 ? ComponentContainerWriter::FlagGzip : 0),
+				tempDirectory
+			));
+		}
+		catch (std::exception const & e) {
+			std::cerr << "Error occured: " << e.what() << std::endl;
+			return -1;
+		}
+	}
 	if (state->cmd.connectedComponents) {
 		graphWriter.reset(
 			new CCGraphWriter(
-				[&](CCGraphWriter::CCId ccId){
-					return graphWriterFactory(outFileName + std::to_string(ccId) + ".cc");
+				[&](CCGraphWriter::CCId ccId, uint64_t nodeCount, uint64_t edgeCount) {
+					if (componentContainer) {
+						return graphWriterFactory(std::string(), componentContainer->component(ccId, nodeCount, edgeCount));
+					}
+					return graphWriterFactory(outFileName + std::to_string(ccId) + (state->cmd.gzipLevel >= -1 ? ".cc.gz" : ".cc"));
 				},
 				state->cmd.cc_filter_mode,
-				state->cmd.cc_filter_value
+				state->cmd.cc_filter_value,
+				state->cmd.threadCount,
+				state->cmd.cc_strong
 			)
 		);
 	}
@@ -334,87 +560,288 @@ int main(int argc, char ** argv) {
 		}
 	}
 
+	//Every pass over the ways decodes the whole input file.
+	//Hence processors that do not depend on each other share a single pass
+	//and passes whose result is already known are skipped.
+	//The first pass over the ways fills the way cache, all later passes read the ways from the cache.
+	WayCache wayCache;
+	if (state->cmd.wayCache) {
+		try {
+			wayCache.create(tempDirectory);
+		}
+		catch (std::exception const & e) {
+			std::cerr << "Error occured: " << e.what() << std::endl;
+			return -1;
+		}
+	}
+	//The first pass over the ways fills the block index, all later passes only read the blocks they need
+	BlockIndex blockIndex;
+	uint32_t wayPassCount = 0;
+	uint32_t wayCachePassCount = 0;
+	uint32_t nodePassCount = 0;
+	auto wayPass = [&](const std::string & message, auto & processor, const std::function<std::string()> & progressStatus = std::function<std::string()>()) {
+		if (wayCache.valid()) {
+			wayCache.parse(message, processor, progressStatus);
+			++wayCachePassCount;
+			return;
+		}
+		inFile.dataSeek(0);
+		bool indexValid = blockIndex.valid();
+		WayParser wayParser(message, inFile, state->cfg.hwTagIds, state->cmd.threadCount, &blockIndex);
+		wayParser.progressStatus = progressStatus;
+		if (wayCache.writable()) {
+			WayCacheWriter wayCacheWriter(wayCache);
+			auto cachingProcessor = chainProcessors(processor, wayCacheWriter);
+			wayParser.parse(cachingProcessor);
+			wayCache.finish();
+		}
+		else {
+			wayParser.parse(processor);
+		}
+		if (!indexValid) {
+			std::cout << "Blocks with nodes: " << blockIndex.dataSize(BlockIndex::BK_NODES)/(1024*1024) << " MiB, ";
+			std::cout << "blocks with ways: " << blockIndex.dataSize(BlockIndex::BK_WAYS)/(1024*1024) << " MiB" << std::endl;
+		}
+		++wayPassCount;
+	};
+
+	//Nodes are written while collecting them unless the writer needs the node degrees
+	//or unneeded nodes are removed afterwards. Only their coordinates are kept for the weight calculators.
+	bool needNodeDegrees = (state->cmd.graphType == GT_SSERIALIZE_OFFSET_ARRAY || state->cmd.graphType == GT_SSERIALIZE_LARGE_OFFSET_ARRAY);
+	bool nodesWritten = false;
+	if (needNodeDegrees && state->cmd.contractChains) {
+		std::cerr << "--contract-chains is not supported by sserialize graph types" << std::endl;
+		return -1;
+	}
+	//the cells refer to the node ids of the whole graph, which -cc changes
+	if (state->cmd.partitionCellBits >= 0 && state->cmd.connectedComponents) {
+		std::cerr << "--partition is not supported together with -cc" << std::endl;
+		return -1;
+	}
+	//nodes are written after the chains and the node order are known
+	bool deferNodes = needNodeDegrees || state->cmd.contractChains || state->cmd.nodeOrder != NO_INPUT || state->cmd.partitionCellBits >= 0;
+	auto beginNodes = [&](uint64_t nodeCount) {
+		std::cout << "Graph has " << nodeCount << " nodes and " << state->edgeCount << " edges." << std::endl;
+		graphWriter->beginGraph();
+		graphWriter->beginHeader();
+		graphWriter->writeHeader(nodeCount, state->edgeCount);
+		graphWriter->endHeader();
+		graphWriter->beginNodes();
+	};
+
 	{
-		//Now get all nodeRefs we need, store node usage count in state->osmIdToMyNodeId
-		{
-			if (state->cmd.hugheHashMapPopulate >= 0) {
-				inFile.dataSeek(0);
-				MinMaxNodeIdProcessor minMaxNodeIdProcessor;
-				WayParser wayParser("Calculating min/max node id for direct hash map", inFile, state->cfg.hwTagIds);
-				wayParser.parse(minMaxNodeIdProcessor);
-				minMaxNodeIdProcessor.largestId.update(0);
-				minMaxNodeIdProcessor.smallestId.update(minMaxNodeIdProcessor.largestId.value());
-				int64_t largestId = minMaxNodeIdProcessor.largestId.value();
-				int64_t smallestId = minMaxNodeIdProcessor.smallestId.value();
-				std::cout << "Min nodeId=" << smallestId << "\nMax nodeId=" << largestId << "\n";
-				if (state->cmd.hugheHashMapPopulate > 0) {
-					largestId= std::min<uint64_t>(smallestId+state->cmd.hugheHashMapPopulate, largestId);
-				}
-				//check if a normal map would be better.
-				//Utilization of std::unordered_map should be above 33%
-				if (largestId-smallestId < int64_t(minMaxNodeIdProcessor.refNodeCount)*3) { 
-					std::cout << "Direct mapped cache: range=[" << smallestId << ":" << largestId << "], max node count=" << minMaxNodeIdProcessor.refNodeCount << ", max utilization=" << double(largestId-smallestId)/minMaxNodeIdProcessor.refNodeCount << std::endl;
-					state->osmIdToMyNodeId = State::OsmIdToMyNodeIdHashMap(minMaxNodeIdProcessor.smallestId.value(), largestId, sserialize::MM_SHARED_MEMORY);
+		//Now get all nodeRefs we need, store node status in state->osmIdToMyNodeId
+		if (state->cmd.hugheHashMapPopulate >= 0) {
+			MinMaxNodeIdProcessor minMaxNodeIdProcessor;
+			wayPass("Calculating min/max node id for direct hash map", minMaxNodeIdProcessor);
+			minMaxNodeIdProcessor.largestId.update(0);
+			minMaxNodeIdProcessor.smallestId.update(minMaxNodeIdProcessor.largestId.value());
+			int64_t largestId = minMaxNodeIdProcessor.largestId.value();
+			int64_t smallestId = minMaxNodeIdProcessor.smallestId.value();
+			std::cout << "Min nodeId=" << smallestId << "\nMax nodeId=" << largestId << "\n";
+			if (state->cmd.hugheHashMapPopulate > 0) {
+				largestId= std::min<uint64_t>(smallestId+state->cmd.hugheHashMapPopulate, largestId);
+				std::cout << "Direct mapped cache: range=[" << smallestId << ":" << largestId << "]" << std::endl;
+				state->osmIdToMyNodeId = State::OsmIdToMyNodeIdMap(smallestId, largestId, NodeIdMap::NM_HASH);
+			}
+			else {
+				//Choose the map needing less memory:
+				//the rank map needs about 3 bits per osm id in the range until node ids are assigned,
+				//std::unordered_map about 40 Bytes per node
+				uint64_t rankMapSize = NodeIdMap::rankMemoryUsage(largestId-smallestId+1);
+				uint64_t hashMapSize = minMaxNodeIdProcessor.refNodeCount*40;
+				if (rankMapSize < hashMapSize) {
+					std::cout << "Rank map: range=[" << smallestId << ":" << largestId << "], size=" << rankMapSize/(1024*1024) << " MiB" << std::endl;
+					state->osmIdToMyNodeId = State::OsmIdToMyNodeIdMap(smallestId, largestId, NodeIdMap::NM_RANK);
 				}
 				else {
-					std::cout << "There are not enough nodes in the data set to warrant the usage of a direct mapped cache" << std::endl;
+					std::cout << "There are not enough nodes in the data set to warrant the usage of a rank map" << std::endl;
 				}
 			}
-		
-			inFile.dataSeek(0);
-			AllNodesGatherProcessor allNodesGatherProcessor(state);
-			WayParser wayParser("Collecting candidate node refs", inFile, state->cfg.hwTagIds);
-			wayParser.parse(allNodesGatherProcessor);
 		}
 		
-		deleteAvailableNodes(inFile, state);
-		//state->osmIdToMyNodeId now only contains nodes that could not be retrieved
-		if (state->osmIdToMyNodeId.size()) { //check if we have to mark some ways invalid
-			inFile.dataSeek(0);
-			InvalidWayMarkingProcessor iwmP(state);
-			WayParser wayParser("Marking invalid ways", inFile, state->cfg.hwTagIds);
-			wayParser.parse(iwmP);
-		}
-		state->osmIdToMyNodeId.clear();
-		
-		assert(state->edgeCount == 0);
-		assert(state->osmIdToMyNodeId.size() == 0);
+		if (state->cmd.singleNodePass && state->osmIdToMyNodeId.idsByRank()) {
+			std::cout << "The rank map does not support a single node pass, reading the nodes twice" << std::endl;
+			state->cmd.singleNodePass = false;
+		}
 		
-		//Rebuild nodeId hash, but this time invalid ways are taken into account
-		inFile.dataSeek(0);
-		NodeRefGatherProcessor refGatherProcessor(state);
-		WayParser wayParser("Collecting needed node refs", inFile, state->cfg.hwTagIds);
-		wayParser.parse(refGatherProcessor);
+		//The edge count is only correct if there are no invalid ways.
+		//This is checked below after finding the available nodes.
+		{
+			AllNodesGatherProcessor allNodesGatherProcessor(state);
+			EdgeCountProcessor edgeCountProcessor(state);
+			auto processor = chainProcessors(allNodesGatherProcessor, edgeCountProcessor);
+			wayPass("Collecting candidate node refs", processor);
+		}
 		
-		//Really fetch the nodes
-		state->nodes.reserve(state->osmIdToMyNodeId.size());
-		gatherNodes(inFile, state);
+		uint64_t candidateNodeCount = state->osmIdToMyNodeId.size();
+		if (state->cmd.singleNodePass) {
+			//Fetch all candidate nodes right away. The ids of the nodes of invalid ways are removed afterwards.
+			state->nodes.reserve(candidateNodeCount);
+			gatherNodes(inFile, blockIndex, state, State::NodeCandidate, candidateNodeCount);
+			++nodePassCount;
+			if (state->nodes.size() < candidateNodeCount) {
+				std::cout << candidateNodeCount-state->nodes.size() << " referenced nodes are not available" << std::endl;
+				state->edgeCount = 0;
+				InvalidWayMarkingProcessor iwmP(state);
+				CollectedNodeRefGatherProcessor refGatherProcessor(state);
+				auto processor = chainProcessors(iwmP, refGatherProcessor);
+				wayPass("Marking invalid ways and collecting needed node refs", processor);
+				std::cout << "Found " << state->invalidWays.size() << " invalid ways" << std::endl;
+				compactNodes(state, refGatherProcessor.neededNodes);
+			}
+			else {
+				std::cout << "All referenced nodes are available, skipping invalid way detection" << std::endl;
+			}
+		}
+		else {
+			uint64_t neededNodeCount = markAvailableNodes(inFile, blockIndex, state);
+			uint32_t neededNodeMarker = State::NodeAvailable;
+			++nodePassCount;
+			if (neededNodeCount < candidateNodeCount) {
+				std::cout << candidateNodeCount-neededNodeCount << " referenced nodes are not available" << std::endl;
+				//Ways with unavailable nodes are invalid.
+				//Mark them and recollect the node refs and edge count of the remaining ways in the same pass
+				state->edgeCount = 0;
+				InvalidWayMarkingProcessor iwmP(state);
+				NodeRefGatherProcessor refGatherProcessor(state);
+				auto processor = chainProcessors(iwmP, refGatherProcessor);
+				wayPass("Marking invalid ways and collecting needed node refs", processor);
+				std::cout << "Found " << state->invalidWays.size() << " invalid ways" << std::endl;
+				neededNodeMarker = State::NodeNeeded;
+				neededNodeCount = refGatherProcessor.neededNodeCount;
+			}
+			else {
+				std::cout << "All referenced nodes are available, skipping invalid way detection" << std::endl;
+			}
+			
+			//Really fetch the nodes
+			if (!deferNodes) {
+				beginNodes(neededNodeCount);
+				gatherNodes(inFile, blockIndex, state, neededNodeMarker, neededNodeCount, graphWriter.get());
+				graphWriter->endNodes();
+				nodesWritten = true;
+			}
+			else {
+				state->nodes.reserve(neededNodeCount);
+				gatherNodes(inFile, blockIndex, state, neededNodeMarker, neededNodeCount);
+			}
+			++nodePassCount;
+		}
 	}
 	
-	if (state->cmd.graphType == GT_SSERIALIZE_OFFSET_ARRAY || state->cmd.graphType == GT_SSERIALIZE_LARGE_OFFSET_ARRAY) {
+	if (needNodeDegrees) {
 		NodeDegreeProcessor nodeDegreeProcessor(state);
-		inFile.dataSeek(0);
-		WayParser wayParser("Adding node degree information", inFile, state->cfg.hwTagIds);
-		wayParser.parse(nodeDegreeProcessor);
+		wayPass("Adding node degree information", nodeDegreeProcessor);
 	}
 	
-	std::cout << "Graph has " << state->nodes.size() << " nodes and " << state->edgeCount << " edges." << std::endl;
+	//nodes of the written graph and their coordinates, state->nodeCoordinates stays indexed by the ids of state->osmIdToMyNodeId
+	const StoredCoordinates * writtenNodeCoordinates = state->nodeCoordinates.data();
+	std::vector<StoredCoordinates> remappedNodeCoordinates;
+	if (state->cmd.contractChains) {
+		uint64_t edgeCount = state->edgeCount;
+		ChainNodeProcessor chainNodeProcessor(state, state->nodes.size());
+		wayPass("Finding chains of nodes with degree 2", chainNodeProcessor);
+		uint32_t nodeCount = chainNodeProcessor.finish();
+		std::cout << "Contracting chains removes " << state->nodes.size()-nodeCount << " nodes and " << edgeCount-state->edgeCount << " edges" << std::endl;
+		remappedNodeCoordinates.reserve(nodeCount);
+		for(std::size_t i(0), s(state->nodes.size()); i < s; ++i) {
+			uint32_t nodeId = state->writtenNodeIds[i];
+			if (nodeId != State::ContractedNode) {
+				if (nodeId != i) {
+					state->nodes[nodeId] = std::move(state->nodes[i]);
+				}
+				state->nodes[nodeId].id = nodeId;
+				remappedNodeCoordinates.push_back(state->nodeCoordinates[i]);
+			}
+		}
+		state->nodes.resize(nodeCount);
+		writtenNodeCoordinates = remappedNodeCoordinates.data();
+	}
 	
-	{//write the nodes out
-		state->nodeCoordinates.reserve(state->nodes.size());
-		graphWriter->beginGraph();
-		graphWriter->beginHeader();
-		graphWriter->writeHeader(state->nodes.size(), state->edgeCount);
-		graphWriter->endHeader();
-		graphWriter->beginNodes();
+	//moves node i of the written graph to nodeIds[i]
+	auto renumberNodes = [&](std::vector<uint32_t> && nodeIds) {
+		std::size_t nodeCount = state->nodes.size();
+		std::vector<Node> nodes(nodeCount);
+		std::vector<StoredCoordinates> coordinates(nodeCount);
+		for(std::size_t i(0); i < nodeCount; ++i) {
+			uint32_t nodeId = nodeIds[i];
+			nodes[nodeId] = std::move(state->nodes[i]);
+			nodes[nodeId].id = nodeId;
+			coordinates[nodeId] = writtenNodeCoordinates[i];
+		}
+		if (state->writtenNodeIds.size()) {
+			for(uint32_t & nodeId : state->writtenNodeIds) {
+				if (nodeId != State::ContractedNode) {
+					nodeId = nodeIds[nodeId];
+				}
+			}
+		}
+		else {
+			state->writtenNodeIds = std::move(nodeIds);
+		}
+		state->nodes.swap(nodes);
+		remappedNodeCoordinates.swap(coordinates);
+		writtenNodeCoordinates = remappedNodeCoordinates.data();
+	};
+	
+	if (state->cmd.nodeOrder != NO_INPUT) {
+		std::cout << "Ordering nodes along the " << (state->cmd.nodeOrder == NO_HILBERT ? "Hilbert" : "Morton") << " curve" << std::endl;
+		renumberNodes(spatialNodeOrder(writtenNodeCoordinates, state->nodes.size(), state->cmd.nodeOrder, state->cmd.threadCount));
+	}
+	
+	if (state->cmd.partitionCellBits >= 0) {
+		Partitioner partitioner(writtenNodeCoordinates, state->nodes.size(), state->cmd.threadCount);
+		{
+			PartitionEdgeProcessor partitionEdgeProcessor(state);
+			wayPass("Collecting edges for the partition", partitionEdgeProcessor);
+			std::cout << "Partitioning the graph into cells of at most " << (uint64_t(1) << state->cmd.partitionCellBits) << " nodes" << std::endl;
+			try {
+				partitioner.run(std::move(partitionEdgeProcessor.edges), uint32_t(1) << state->cmd.partitionCellBits);
+			}
+			catch (std::exception const & e) {
+				std::cerr << "Error occured: " << e.what() << std::endl;
+				return -1;
+			}
+			std::cout << "The partition has " << partitioner.cellCount() << " cells" << std::endl;
+		}
+		if (state->cmd.partitionOrder) {
+			std::vector<uint32_t> nodeIds = partitioner.nodeOrder();
+			partitioner.renumber(nodeIds);
+			renumberNodes(std::move(nodeIds));
+		}
+		if (state->cmd.graphType != GT_NONE) {
+			std::string cellsFileName = outFileName + ".cells";
+			std::ofstream cellsFile(cellsFileName, std::ios::binary);
+			if (!cellsFile.is_open()) {
+				std::cerr << "Failed to open cells file " << cellsFileName << std::endl;
+				return -1;
+			}
+			try {
+				partitioner.write(cellsFile);
+			}
+			catch (std::exception const & e) {
+				std::cerr << "Error occured: " << e.what() << std::endl;
+				return -1;
+			}
+		}
+	}
+	
+	if (placedEdgeWriter) {
+		EdgeOffsetProcessor edgeOffsetProcessor(state, state->writtenNodeIds.size() ? state->nodes.size() : state->nodeCoordinates.size());
+		wayPass("Calculating edge offsets", edgeOffsetProcessor);
+		placedEdgeWriter->setEdgeOffsets(edgeOffsetProcessor.offsets());
+	}
+	
+	if (!nodesWritten) {//write the nodes out
+		beginNodes(state->nodes.size());
 		sserialize::ProgressInfo info;
 		info.begin(state->nodes.size(), "Writing out nodes");
-		for(std::size_t i = 0, s = state->nodes.size(); i < s; ++i) {
-			graphWriter->writeNode(state->nodes[i], state->nodeCoordinates[i]);
-		}
+		graphWriter->writeNodes(state->nodes.data(), writtenNodeCoordinates, state->nodes.size());
 		info.end();
 		graphWriter->endNodes();
 		state->nodes = std::vector<Node>();
+		remappedNodeCoordinates = std::vector<StoredCoordinates>();
 	}
 
 	{
@@ -434,14 +861,51 @@ int main(int argc, char ** argv) {
 			weightCalculator.reset(new GeodesicDistanceWeightCalculator(state));
 			break;
 		};
-		FinalWayProcessor finalWayProcessor(state, graphWriter, weightCalculator);
-		inFile.dataSeek(0);
-		WayParser wayParser("Processing ways", inFile, state->cfg.hwTagIds);
+		//A full output queue means that writing the graph is I/O-bound
+		std::function<std::string()> outputStatus;
+		if (auto out = asyncOutput.lock()) {
+			outputStatus = [out]() {
+				return "output queue " + std::to_string(out->buffer().queueDepth()) + "/" + std::to_string(out->buffer().queueSize());
+			};
+		}
+		//the inner points of contracted chains refer to the node ids of the whole graph, which -cc changes
+		std::shared_ptr<ShapeFileWriter> shapeWriter;
+		if (state->cmd.contractChains && !state->cmd.connectedComponents && state->cmd.graphType != GT_NONE) {
+			std::string shapeFileName = outFileName + (state->cmd.gzipLevel >= -1 ? ".shape.gz" : ".shape");
+			auto shapeFile = std::make_shared<std::ofstream>(shapeFileName, std::ios::binary);
+			if (!shapeFile->is_open()) {
+				std::cerr << "Failed to open shape file " << shapeFileName << std::endl;
+				return -1;
+			}
+			std::shared_ptr<std::ostream> shapeStream = shapeFile;
+			if (state->cmd.gzipLevel >= -1) {
+				shapeStream = std::make_shared<GzipOutputStream>(shapeStream, state->cmd.threadCount, state->cmd.gzipLevel);
+			}
+			shapeWriter = std::make_shared<ShapeFileWriter>(shapeStream);
+			//records refer to their edge by its rank among the edges with the same source and target
+			ChainEdgeProcessor chainEdgeProcessor(state);
+			wayPass("Collecting edges of contracted chains", chainEdgeProcessor);
+			shapeWriter->setChainEdges(chainEdgeProcessor.finish());
+		}
+		FinalWayProcessor finalWayProcessor(state, graphWriter, weightCalculator, shapeWriter);
 		graphWriter->beginEdges();
-		wayParser.parse(finalWayProcessor);
+		wayPass("Processing ways", finalWayProcessor, outputStatus);
+		finalWayProcessor.flush();
 		graphWriter->endEdges();
+		if (shapeWriter) {
+			shapeWriter->flush();
+		}
 	}
 	graphWriter->endGraph();
+	if (componentContainer) {
+		componentContainer->finish();
+	}
+	if (auto out = asyncOutput.lock()) {
+		std::cout << "Waited " << out->buffer().waitTime() << " s for the output thread" << std::endl;
+	}
+	
+	std::cout << "Scanned the input " << wayPassCount << " times for ways and " << nodePassCount << " times for nodes, ";
+	std::cout << "read the way cache " << wayCachePassCount << " times" << std::endl;
 
 	return 0;
 }
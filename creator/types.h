@@ -1,12 +1,18 @@
 #ifndef OSM_GRAPH_TOOLS_TYPES_H
 #define OSM_GRAPH_TOOLS_TYPES_H
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
 #include <memory>
 #include <string>
 #include <stdint.h>
+#include <limits>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include <sserialize/containers/DirectHugeHash.h>
+#include "NodeIdMap.h"
 #include <sserialize/spatial/GeoRect.h>
 
 namespace osm {
@@ -15,6 +21,8 @@ namespace creator {
 
 enum OneWayStatus {OW_YES, OW_NO, OW_IMPLICIT};
 enum WeightCalculatorType {WC_NONE, WC_DISTANCE, WC_TIME, WC_MAXSPEED};
+///Order of the node ids in the written graph
+enum NodeOrder {NO_INPUT, NO_HILBERT, NO_MORTON};
 enum GraphType {GT_NONE, GT_TOPO_TEXT, GT_TOPO_BINARY, GT_FMI_TEXT, GT_FMI_BINARY, GT_FMI_MAXSPEED_BINARY, GT_FMI_MAXSPEED_TEXT, GT_SSERIALIZE_OFFSET_ARRAY, GT_PLOT, GT_SSERIALIZE_LARGE_OFFSET_ARRAY};
 
 enum class FilterMode {
@@ -32,6 +40,23 @@ struct Coordinates {
 	double lon;
 };
 
+///Coordinates stored as fixed point numbers with a resolution of 1e-7 degrees which is the precision of osm data.
+///Converts implicitly from and to Coordinates
+struct FixedPointCoordinates {
+	static constexpr double Resolution = 1e7;
+	FixedPointCoordinates() {}
+	FixedPointCoordinates(const Coordinates & c) : lat(std::lround(c.lat*Resolution)), lon(std::lround(c.lon*Resolution)) {}
+	inline operator Coordinates() const { return Coordinates(lat/Resolution, lon/Resolution); }
+	int32_t lat;
+	int32_t lon;
+};
+
+#ifdef CONFIG_CREATOR_FIXED_POINT_COORDINATES
+typedef FixedPointCoordinates StoredCoordinates;
+#else
+typedef Coordinates StoredCoordinates;
+#endif
+
 //[Id] [osmId] [lat] [lon] [elevation] [carryover] //Knoten
 struct Node {
 	Node() {}
@@ -72,12 +97,71 @@ struct Edge {
 #endif
 };
 
+///A set of ways given by the position of the way in the sequence of ways seen by a way pass.
+///Every way pass sees the same ways in the same order, hence the position identifies a way.
+///Membership is stored in a single bit per way.
+class WayOrdinalSet {
+public:
+	WayOrdinalSet() {}
+	inline void insert(uint64_t wayOrdinal) {
+		uint64_t word = wayOrdinal/64;
+		if (word >= m_d.size()) {
+			m_d.resize(std::max<std::size_t>(word+1, m_d.size()*2), 0);
+		}
+		uint64_t mask = uint64_t(1) << (wayOrdinal%64);
+		if (!(m_d[word] & mask)) {
+			m_d[word] |= mask;
+			++m_size;
+		}
+	}
+	inline std::size_t count(uint64_t wayOrdinal) const {
+		uint64_t word = wayOrdinal/64;
+		return word < m_d.size() && (m_d[word] >> (wayOrdinal%64)) & 1;
+	}
+	inline std::size_t size() const { return m_size; }
+	inline void clear() {
+		m_d = std::vector<uint64_t>();
+		m_size = 0;
+	}
+private:
+	std::vector<uint64_t> m_d;
+	std::size_t m_size{0};
+};
+
 struct State {
 	struct Configuration {
+		static constexpr int MaxTypeId = 0xFFFF;
 		std::unordered_map<std::string, int> hwTagIds;
 		std::unordered_map<int, double> typeToWeight; //weight is in 1/100 sec to travel 1 m
 		std::unordered_set<int> implicitOneWay;
-		inline double maxSpeedFromType(int type) { return 360.0/typeToWeight.at(type); }
+		///Dense tables indexed by type id used on the hot paths, call buildTypeTables() after changing the maps above
+		std::vector<double> typeWeights;
+		std::vector<double> typeMaxSpeeds;
+		std::vector<uint8_t> typeImplicitOneWay;
+		inline double weightFromType(int type) const { assert(type >= 0 && std::size_t(type) < typeWeights.size()); return typeWeights[type]; }
+		inline double maxSpeedFromType(int type) const { assert(type >= 0 && std::size_t(type) < typeMaxSpeeds.size()); return typeMaxSpeeds[type]; }
+		inline bool isImplicitOneWay(int type) const { return type >= 0 && std::size_t(type) < typeImplicitOneWay.size() && typeImplicitOneWay[type]; }
+		void buildTypeTables() {
+			int maxType = -1;
+			for(const auto & x : typeToWeight) {
+				if (x.first < 0 || x.first > MaxTypeId) {
+					throw std::runtime_error("Type ids have to be in [0, " + std::to_string(MaxTypeId) + "]");
+				}
+				maxType = std::max(maxType, x.first);
+			}
+			typeWeights.assign(maxType+1, std::numeric_limits<double>::quiet_NaN());
+			typeMaxSpeeds.assign(maxType+1, std::numeric_limits<double>::quiet_NaN());
+			typeImplicitOneWay.assign(maxType+1, 0);
+			for(const auto & x : typeToWeight) {
+				typeWeights[x.first] = x.second;
+				typeMaxSpeeds[x.first] = 360.0/x.second;
+			}
+			for(int type : implicitOneWay) {
+				if (type >= 0 && type <= maxType) {
+					typeImplicitOneWay[type] = 1;
+				}
+			}
+		}
 	} cfg;
 	struct CommandLineOptions {
 		bool withBounds = false;
@@ -89,15 +173,40 @@ struct State {
 		bool connectedComponents = false;
 		FilterMode cc_filter_mode;
 		std::size_t cc_filter_value{0};
+		bool cc_strong = false; ///split into strongly connected components
+		bool ccContainer = false; ///write all connected components into a single ComponentContainer file
 		bool addReverseEdges = true;
 		double distanceMult = 1; ///multiply with distance: 1000 -> distance is in mm
 		double timeMult = 100; ///multiply with time: 1000 -> time is in ms 
+		uint32_t threadCount = 1; ///number of threads used to decode blocks
+		bool wayCache = true; ///cache ways after the first pass instead of decoding the input again
+		std::string wayCacheDirectory; ///directory of the way cache and other temporary files, empty: use TMPDIR
+		uint64_t sortMemory = uint64_t(4096) << 20; ///memory budget of sorting edges in bytes
+		bool placeEdges = false; ///sort edges by placing them at the position given by the node degrees instead of sorting them
+		bool placeEdgesSortTargets = true; ///sort placed edges with the same source by target
+		bool singleNodePass = false; ///collect all candidate nodes in one pass and remove the unneeded ones afterwards
+		bool fastDistance = false; ///approximate the length of short edges, see EdgeLengthCalculator
+		bool asyncOutput = false; ///write the output in a dedicated thread
+		int gzipLevel = -2; ///compress the output with gzip using threadCount threads, -2: no compression, -1: default level of zlib
+		int coordinatePrecision = std::numeric_limits<double>::digits10 + 2; ///decimal digits of coordinates in text formats, -1: shortest round-trip representation
+		bool contractChains = false; ///replace chains of nodes with degree 2 by a single edge
+		NodeOrder nodeOrder = NO_INPUT; ///renumber the nodes along a space filling curve
+		int partitionCellBits = -1; ///partition the graph into cells of at most 2^partitionCellBits nodes, -1: no partition
+		bool partitionOrder = false; ///renumber the nodes such that the nodes of a cell have consecutive ids
 	} cmd;
-	typedef sserialize::DirectHugeHashMap<uint32_t> OsmIdToMyNodeIdHashMap;
-	OsmIdToMyNodeIdHashMap osmIdToMyNodeId;
-	std::unordered_set<int64_t> invalidWays;
-	std::vector<Coordinates> nodeCoordinates;
+	typedef NodeIdMap OsmIdToMyNodeIdMap;
+	///Until node ids are assigned osmIdToMyNodeId stores the status of a node
+	static constexpr uint32_t NodeCandidate = NodeIdMap::NodeCandidate; ///referenced by some way
+	static constexpr uint32_t NodeAvailable = NodeIdMap::NodeAvailable; ///referenced and present in the input
+	static constexpr uint32_t NodeNeeded = NodeIdMap::NodeNeeded; ///referenced by a valid way
+	OsmIdToMyNodeIdMap osmIdToMyNodeId;
+	WayOrdinalSet invalidWays; ///ways are given by their position in a way pass
+	std::vector<StoredCoordinates> nodeCoordinates; ///convert to Coordinates before use
 	std::vector<Node> nodes; //this is only temporarily valid and gets deleted after writing out the nodes
+	static constexpr uint32_t ContractedNode = std::numeric_limits<uint32_t>::max();
+	///The id in the written graph of every node or ContractedNode if it is removed by cmd.contractChains.
+	///Empty if the nodes are written with the ids of state->osmIdToMyNodeId
+	std::vector<uint32_t> writtenNodeIds;
 	uint64_t edgeCount;
 	State() : edgeCount(0) {}
 };
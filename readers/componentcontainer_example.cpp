@@ -0,0 +1,34 @@
+#include <iostream>
+#include <cstdlib>
+#include "componentcontainerreader.h"
+
+///Lists the components of a container or writes the data of a single component to stdout
+int main(int argc, char ** argv) {
+	if (argc < 2) {
+		std::cerr << "Not enough arguments. Need filename [ccid]\n";
+		return -1;
+	}
+	OsmGraphWriter::ComponentContainerReader container;
+	try {
+		container.open(argv[1]);
+		if (argc < 3) {
+			std::cout << "# ccid nodes edges bytes" << (container.compressed() ? " (gzip)" : "") << "\n";
+			for(const auto & c : container.components()) {
+				std::cout << c.ccId << " " << c.nodeCount << " " << c.edgeCount << " " << c.size << "\n";
+			}
+		}
+		else {
+			std::size_t i = container.find(std::strtoull(argv[2], 0, 10));
+			if (i == container.components().size()) {
+				std::cerr << "No component with id " << argv[2] << "\n";
+				return -1;
+			}
+			std::cout.write(container.data(i), container.components()[i].size);
+		}
+	}
+	catch (const std::exception & e) {
+		std::cerr << "Failed to read the container: " << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "componentcontainerreader.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <stdexcept>
+
+namespace OsmGraphWriter {
+
+namespace {
+
+const std::size_t EntrySize = 5*8;
+const std::size_t TrailerSize = 3*8;
+
+uint64_t getBigEndian(const unsigned char * d) {
+	uint64_t v = 0;
+	for(int i(0); i < 8; ++i) {
+		v = (v << 8) | d[i];
+	}
+	return v;
+}
+
+void readAt(int fd, unsigned char * dest, std::size_t size, off_t offset) {
+	while (size) {
+		ssize_t len = ::pread(fd, dest, size, offset);
+		if (len <= 0) {
+			throw std::runtime_error("Could not read container index");
+		}
+		dest += len;
+		size -= len;
+		offset += len;
+	}
+}
+
+}//end namespace
+
+ComponentContainerReader::ComponentContainerReader() : m_fd(-1), m_compressed(false) {}
+
+ComponentContainerReader::~ComponentContainerReader() {
+	close();
+}
+
+void ComponentContainerReader::open(const char * path) {
+	close();
+	m_fd = ::open(path, O_RDONLY);
+	if (m_fd < 0) {
+		throw std::runtime_error("Could not open file");
+	}
+	struct ::stat stFileInfo;
+	if (::fstat(m_fd, &stFileInfo) != 0) {
+		close();
+		throw std::runtime_error("Could not stat file");
+	}
+	uint64_t fileSize = stFileInfo.st_size;
+	try {
+		if (fileSize < TrailerSize) {
+			throw std::runtime_error("File is too small to be a component container");
+		}
+		unsigned char trailer[TrailerSize];
+		readAt(m_fd, trailer, TrailerSize, fileSize-TrailerSize);
+		if (memcmp(trailer+16, "OGCCONT1", 8) != 0) {
+			throw std::runtime_error("File is not a component container");
+		}
+		uint64_t entryCount = getBigEndian(trailer);
+		m_compressed = getBigEndian(trailer+8) & 0x1;
+		if (entryCount > (fileSize-TrailerSize)/EntrySize) {
+			throw std::runtime_error("Invalid container index");
+		}
+		uint64_t indexBegin = fileSize - TrailerSize - entryCount*EntrySize;
+		std::vector<unsigned char> index(entryCount*EntrySize);
+		readAt(m_fd, index.data(), index.size(), indexBegin);
+		m_components.resize(entryCount);
+		for(uint64_t i(0); i < entryCount; ++i) {
+			const unsigned char * d = index.data() + i*EntrySize;
+			Component & c = m_components[i];
+			c.ccId = getBigEndian(d);
+			c.nodeCount = getBigEndian(d+8);
+			c.edgeCount = getBigEndian(d+16);
+			c.offset = getBigEndian(d+24);
+			c.size = getBigEndian(d+32);
+			if (c.offset > indexBegin || c.size > indexBegin - c.offset) {
+				throw std::runtime_error("Invalid container index");
+			}
+		}
+		m_mappings.assign(entryCount, Mapping{0, 0});
+	}
+	catch (...) {
+		close();
+		throw;
+	}
+}
+
+void ComponentContainerReader::close() {
+	for(const Mapping & m : m_mappings) {
+		if (m.base) {
+			::munmap(m.base, m.size);
+		}
+	}
+	m_mappings.clear();
+	m_components.clear();
+	m_compressed = false;
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+std::size_t ComponentContainerReader::find(uint64_t ccId) const {
+	auto it = std::lower_bound(m_components.begin(), m_components.end(), ccId, [](const Component & c, uint64_t id) {
+		return c.ccId < id;
+	});
+	if (it != m_components.end() && it->ccId == ccId) {
+		return it - m_components.begin();
+	}
+	return m_components.size();
+}
+
+const char * ComponentContainerReader::data(std::size_t i) {
+	if (i >= m_components.size()) {
+		throw std::out_of_range("Invalid component");
+	}
+	const Component & c = m_components[i];
+	//mappings have to start at a page boundary
+	uint64_t pageSize = ::sysconf(_SC_PAGESIZE);
+	uint64_t begin = c.offset - c.offset % pageSize;
+	Mapping & m = m_mappings[i];
+	if (!m.base) {
+		std::size_t size = c.offset - begin + c.size;
+		if (!size) {
+			return 0;
+		}
+		void * data = ::mmap(0, size, PROT_READ, MAP_SHARED, m_fd, begin);
+		if (data == MAP_FAILED) {
+			throw std::runtime_error("Could not mmap component");
+		}
+		m = Mapping{data, size};
+	}
+	return static_cast<const char*>(m.base) + (c.offset - begin);
+}
+
+}//end namespace
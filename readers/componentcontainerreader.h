@@ -0,0 +1,55 @@
+#ifndef OSM_GRAPH_CREATOR_COMPONENT_CONTAINER_READER_H
+#define OSM_GRAPH_CREATOR_COMPONENT_CONTAINER_READER_H
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace OsmGraphWriter {
+
+/** Reads a container with many graphs as written by creator with --cc-container.
+  *
+  * Format, all numbers are big endian uint64_t:
+  * --------------------------------------------------------------------------------------------------------
+  * DATA OF ALL COMPONENTS|(CCID|NODECOUNT|EDGECOUNT|OFFSET|SIZE)*ENTRYCOUNT|ENTRYCOUNT|FLAGS|"OGCCONT1"
+  * --------------------------------------------------------------------------------------------------------
+  *
+  * Only the index is read by open(), the data of a component is mapped into memory when it is accessed the first time.
+  */
+class ComponentContainerReader {
+public:
+	struct Component {
+		uint64_t ccId;
+		uint64_t nodeCount;
+		uint64_t edgeCount;
+		uint64_t offset; ///relative to the begin of the file
+		uint64_t size; ///in bytes
+	};
+public:
+	ComponentContainerReader();
+	virtual ~ComponentContainerReader();
+	///reads the index of the container at path
+	void open(const char * path);
+	///unmaps all components and closes the file
+	void close();
+	///all components sorted by ccId
+	inline const std::vector<Component> & components() const { return m_components; }
+	///true if the data of every component is gzip compressed
+	inline bool compressed() const { return m_compressed; }
+	///@return position of the component with ccId in components() or components().size() if there is none
+	std::size_t find(uint64_t ccId) const;
+	///maps the data of the i-th component, it stays valid until close() is called
+	const char * data(std::size_t i);
+private:
+	struct Mapping {
+		void * base;
+		std::size_t size;
+	};
+private:
+	int m_fd;
+	std::vector<Component> m_components;
+	std::vector<Mapping> m_mappings;
+	bool m_compressed;
+};
+
+}//end namespace
+#endif
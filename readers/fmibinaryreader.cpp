@@ -5,6 +5,7 @@
 /* memcpy */
 #include <string.h>
 
+#include <algorithm>
 #include <type_traits>
 #include <functional>
 #include <limits>
@@ -49,9 +50,47 @@ static uint64_t my_htobe64(uint64_t x) {
 #include <string>
 #include <sys/stat.h>
 #include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
 
 namespace OsmGraphWriter {
 
+namespace {
+
+std::vector<char> readGzipFile(const char * path) {
+	gzFile file = gzopen(path, "rb");
+	if (!file) {
+		throw std::runtime_error("Could not open file");
+	}
+	gzbuffer(file, 1 << 20);
+	std::vector<char> result;
+	std::size_t size = 0;
+	while (true) {
+		result.resize(std::max<std::size_t>(2*size, 1 << 20));
+		int len = gzread(file, result.data()+size, std::min<std::size_t>(result.size()-size, 1 << 30));
+		if (len < 0) {
+			gzclose(file);
+			throw std::runtime_error("Could not decompress file");
+		}
+		if (len == 0) {
+			//gzread does not fail if the input ends within a gzip member
+			int error = Z_OK;
+			gzerror(file, &error);
+			gzclose(file);
+			if (error == Z_BUF_ERROR) {
+				throw std::runtime_error("Compressed file is truncated");
+			}
+			break;
+		}
+		size += len;
+	}
+	result.resize(size);
+	return result;
+}
+
+}//end namespace
+
 FmiBinaryReader::FmiBinaryReader() {}
 FmiBinaryReader::~FmiBinaryReader() {}
 
@@ -80,6 +119,15 @@ void FmiBinaryReader::read(char * path) {
 		return;
 	}
 	
+	//gzip compressed graphs are decompressed into memory
+	if (fileSize >= 2 && ((unsigned char*)data)[0] == 0x1f && ((unsigned char*)data)[1] == 0x8b) {
+		::munmap(data, fileSize);
+		close(fd);
+		std::vector<char> graph = readGzipFile(path);
+		readGraph(graph.data(), graph.data()+graph.size());
+		return;
+	}
+	
 	readGraph((char*)data, ((char*)data)+fileSize);
 	
 	::munmap(data, fileSize);
@@ -9,18 +9,69 @@
 #include <sys/stat.h>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <streambuf>
+#include <zlib.h>
 
 namespace OsmGraphWriter {
 
+namespace {
+
+///Reads gzip compressed and uncompressed files
+class GzipInputStreamBuffer: public std::streambuf {
+public:
+	GzipInputStreamBuffer(const char * path) : m_file(gzopen(path, "rb")) {
+		if (m_file) {
+			gzbuffer(m_file, BufferSize);
+		}
+	}
+	~GzipInputStreamBuffer() override {
+		if (m_file) {
+			gzclose(m_file);
+		}
+	}
+	bool is_open() const { return m_file; }
+protected:
+	int_type underflow() override {
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+		int len = gzread(m_file, m_buffer, BufferSize);
+		if (len < 0) {
+			throw std::runtime_error("Could not decompress file");
+		}
+		if (len == 0) {
+			//gzread does not fail if the input ends within a gzip member
+			int error = Z_OK;
+			gzerror(m_file, &error);
+			if (error == Z_BUF_ERROR) {
+				throw std::runtime_error("Compressed file is truncated");
+			}
+			return traits_type::eof();
+		}
+		setg(m_buffer, m_buffer, m_buffer+len);
+		return traits_type::to_int_type(*gptr());
+	}
+private:
+	static constexpr unsigned int BufferSize = 1 << 20;
+	gzFile m_file;
+	char m_buffer[BufferSize];
+};
+
+}//end namespace
+
 FmiTextReader::FmiTextReader() {}
 FmiTextReader::~FmiTextReader() {}
 
 void FmiTextReader::read(char * path) {
-	std::ifstream inFile;
-	inFile.open(path);
-	if (!inFile.is_open()) {
+	//gzread reads uncompressed files as they are
+	std::unique_ptr<GzipInputStreamBuffer> buffer(new GzipInputStreamBuffer(path));
+	if (!buffer->is_open()) {
 		throw std::runtime_error("Could not open file");
 	}
+	std::istream inFile(buffer.get());
+	//std::istream swallows exceptions of the buffer and only sets badbit unless asked to rethrow them
+	inFile.exceptions(std::ios::badbit);
 	readGraph(inFile);
 }
 